@@ -0,0 +1,6 @@
+#version 150
+
+// depth-only pass: color writes are masked, so there's nothing to compute
+
+void main() {
+}
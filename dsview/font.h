@@ -0,0 +1,14 @@
+/* font.h */
+
+#ifndef FONT_H_FILE
+#define FONT_H_FILE
+
+#define FONT_FIRST_CHAR  32
+#define FONT_NUM_CHARS   96
+#define FONT_CHAR_WIDTH   5
+#define FONT_CHAR_HEIGHT  8
+
+// each character is FONT_CHAR_WIDTH columns, bit 0 of each column is the top row
+extern const unsigned char font_data[FONT_NUM_CHARS][FONT_CHAR_WIDTH];
+
+#endif /* FONT_H_FILE */
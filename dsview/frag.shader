@@ -4,16 +4,32 @@ varying vec3 frag_pos;
 varying vec3 frag_normal;
 
 out vec3 frag;
-uniform vec3 color;
-uniform vec3 light_pos;
+
+layout(std140, row_major) uniform frame_data {
+  mat4 mat_model_view_projection;
+  mat4 mat_model_view;
+  mat3 mat_normal;
+  vec3 light_pos;
+};
+
+layout(std140) uniform model_data {
+  vec3 color;
+  int flat_shading;
+};
 
 void main() {
+  vec3 normal;
+  if (flat_shading != 0)
+    normal = normalize(cross(dFdx(frag_pos), dFdy(frag_pos)));  // face normal
+  else
+    normal = normalize(frag_normal);
+
   vec3 light_dir = normalize(light_pos - frag_pos);
-  //float diffuse = 0.3 + 0.7*max(dot(frag_normal, light_dir), 0.0);
-  float diffuse = 0.3 + 0.7*abs(dot(frag_normal, light_dir));
+  //float diffuse = 0.3 + 0.7*max(dot(normal, light_dir), 0.0);
+  float diffuse = 0.3 + 0.7*abs(dot(normal, light_dir));
 
   vec3 view_dir = normalize(vec3(0.0,0.0,0.0) - frag_pos);
-  vec3 reflect_dir = reflect(-light_dir, frag_normal);
+  vec3 reflect_dir = reflect(-light_dir, normal);
   //float specular = 0.5 * pow(max(dot(view_dir, reflect_dir), 0.0), 32);
   float specular = 0.5 * pow(abs(dot(view_dir, reflect_dir)), 32);
 
@@ -28,3 +28,62 @@ void check_gl_error(const char *filename, int line_num)
     console("* %s:%d: OpenGL error: %s (0x%x)\n", filename, line_num, error, err);
   }
 }
+
+static const char *get_debug_source_name(GLenum source)
+{
+  switch (source) {
+  case GL_DEBUG_SOURCE_API:             return "api";
+  case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "window system";
+  case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+  case GL_DEBUG_SOURCE_THIRD_PARTY:     return "third party";
+  case GL_DEBUG_SOURCE_APPLICATION:     return "application";
+  default:                              return "other";
+  }
+}
+
+static const char *get_debug_type_name(GLenum type)
+{
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR:               return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behavior";
+  case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+  default:                                return "other";
+  }
+}
+
+static const char *get_debug_severity_name(GLenum severity)
+{
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:   return "high";
+  case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+  case GL_DEBUG_SEVERITY_LOW:    return "low";
+  default:                       return "notification";
+  }
+}
+
+static void APIENTRY debug_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                                            GLsizei length, const GLchar *message, const void *user_param)
+{
+  debug("* OpenGL %s (%s, %s severity, id 0x%x): %.*s\n",
+        get_debug_type_name(type), get_debug_source_name(source), get_debug_severity_name(severity),
+        (unsigned int) id, (int) length, message);
+  if (type == GL_DEBUG_TYPE_ERROR)
+    console("* OpenGL error: %.*s\n", (int) length, message);
+}
+
+int init_gl_debug_output(void)
+{
+  if (! GLAD_GL_KHR_debug) {
+    debug("* WARNING: GL_KHR_debug not supported, OpenGL errors will not be reported asynchronously\n");
+    return 1;
+  }
+
+  // asynchronous output: we don't enable GL_DEBUG_OUTPUT_SYNCHRONOUS
+  glDebugMessageCallback(debug_message_callback, NULL);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL, GL_FALSE);
+  glEnable(GL_DEBUG_OUTPUT);
+  return 0;
+}
@@ -3,9 +3,25 @@
 #ifndef GL_ERROR_H_FILE
 #define GL_ERROR_H_FILE
 
+/*
+ * Release builds (make RELEASE=1) don't call glGetError() after each
+ * GL call, since that may force the driver to synchronize.  Errors are
+ * reported asynchronously through the KHR_debug callback instead.
+ */
+#ifdef GL_RELEASE
+#define GL_CHECK(x)       do { x; } while (0)
+#else
 #define GL_CHECK(x)       do { x; check_gl_error(__FILE__, __LINE__); } while (0)
+#endif
 #define GL_CHECK_ERRORS() GL_CHECK((void)0)
 
+#ifdef GL_RELEASE
+#define GL_CHECK_MODE     "KHR_debug callback"
+#else
+#define GL_CHECK_MODE     "glGetError after each call"
+#endif
+
 void check_gl_error(const char *filename, int line_num);
+int init_gl_debug_output(void);
 
 #endif /* GL_ERROR_H_FILE */
@@ -1,5 +1,6 @@
 /* main.c */
 
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 
@@ -14,6 +15,8 @@
 #include "dir.h"
 #include "mouse_camera.h"
 #include "key_camera.h"
+#include "text.h"
+#include "stats.h"
 
 #define WINDOW_WIDTH  1024
 #define WINDOW_HEIGHT  800
@@ -21,32 +24,58 @@
 #define MAX_SPEED_NORMAL 0.1f
 #define MAX_SPEED_TURBO  3.0f
 
+#define STATS_LOG_INTERVAL 1.0
+
+#define BENCH_WARMUP_FRAMES  60
+#define BENCH_DEFAULT_FRAMES 1000
+
 static GLFWwindow *window;
 
 static int fullscreen_mode;
 static float mat_projection[16];
+static int viewport_width;
+static int viewport_height;
+static int show_stats;
+static int flat_shading;
+static int debug_context = 1;
+static int sort_models = 1;
+static int depth_prepass;
+static int show_overdraw;
 static int use_key_cam = 1;
 static struct mouse_cam mouse_cam;
 static struct key_cam key_cam;
 static float vel_front;
 static float vel_side;
 
+#define FRAME_UBO_BINDING 0
+#define MODEL_UBO_BINDING 1
+
+// layout of the uniform blocks (std140, row_major) in the shaders
+struct frame_uniforms {
+  float mat_model_view_projection[16];
+  float mat_model_view[16];
+  float mat_normal[3][4];  // mat3 rows are padded to vec4
+  float light_pos[4];
+};
+
+struct model_uniforms {
+  float color[3];
+  int32_t flat_shading;
+};
+
 struct shader_program {
   GLuint prog_id;
+  GLuint depth_prog_id;     // depth-only pre-pass
+  GLuint overdraw_prog_id;  // overdraw visualization
 
   GLint attr_vtx_pos;
   GLint attr_vtx_normal;
 
-  GLint uni_mat_model_view_projection;
-  GLint uni_mat_model_view;
-  GLint uni_mat_normal;
-  GLint uni_color;
-  GLint uni_light_pos;
+  GLuint frame_ubo;
+  GLuint model_ubo;
+  GLint model_ubo_stride;
 
-  float mat_model_view_projection[16];
-  float mat_model_view[16];
-  float mat_normal[9];
-  float color[3];
+  struct frame_uniforms frame;
   float light_pos[3];
 };
 static struct shader_program prog;
@@ -57,11 +86,19 @@ struct model_def {
   GLuint vtx_array_obj;
   GLuint vtx_buf_obj;
   GLuint index_buf_obj;
+  GLintptr model_ubo_offset;
   int disable_draw;
 };
 static struct model_def models[32];
 static int n_models;
 
+struct visible_model {
+  struct model_def *def;
+  float dist;
+};
+
+static const char *const shader_attr_names[] = { "vtx_pos", "vtx_normal", NULL };
+
 static int get_shader_attr_id(GLint *id, const char *name)
 {
   GLint attr_id = glGetAttribLocation(prog.prog_id, name);
@@ -72,21 +109,42 @@ static int get_shader_attr_id(GLint *id, const char *name)
   return 0;
 }
 
-static int get_shader_uniform_id(GLint *id, const char *name)
+static int bind_shader_uniform_block(GLuint prog_id, const char *name, GLuint binding)
 {
-  GLint attr_id = glGetUniformLocation(prog.prog_id, name);
+  GLuint block_index = glGetUniformBlockIndex(prog_id, name);
   GL_CHECK_ERRORS();
-  if (attr_id < 0)
-    debug("* WARNING: can't read uniform '%s'\n", name);
-  *id = attr_id;
+  if (block_index == GL_INVALID_INDEX)
+    return 0;  // not used by this program (e.g. model_data in the depth-only pass)
+  GL_CHECK(glUniformBlockBinding(prog_id, block_index, binding));
   return 0;
 }
 
+static GLuint load_model_program(const char *frag_filename)
+{
+  GLuint prog_id = load_program_shader_attribs("vert.shader", frag_filename, shader_attr_names);
+  if (prog_id == 0)
+    return 0;
+
+  // bind uniform blocks
+  if (bind_shader_uniform_block(prog_id, "frame_data", FRAME_UBO_BINDING) != 0)
+    return 0;
+  if (bind_shader_uniform_block(prog_id, "model_data", MODEL_UBO_BINDING) != 0)
+    return 0;
+  return prog_id;
+}
+
 static int init_shaders(void)
 {
-  prog.prog_id = load_program_shader("vert.shader", "frag.shader");
+  // all programs share the vertex shader and attribute locations, so they can use the same VAOs
+  prog.prog_id = load_model_program("frag.shader");
   if (prog.prog_id == 0)
     return 1;
+  prog.depth_prog_id = load_model_program("depth_frag.shader");
+  if (prog.depth_prog_id == 0)
+    return 1;
+  prog.overdraw_prog_id = load_model_program("overdraw_frag.shader");
+  if (prog.overdraw_prog_id == 0)
+    return 1;
 
   // load attribute locations
   if (get_shader_attr_id(&prog.attr_vtx_pos, "vtx_pos") != 0)
@@ -94,17 +152,20 @@ static int init_shaders(void)
   if (get_shader_attr_id(&prog.attr_vtx_normal, "vtx_normal") != 0)
     return 1;
 
-  // load uniform locations
-  if (get_shader_uniform_id(&prog.uni_mat_model_view_projection, "mat_model_view_projection") != 0)
-    return 1;
-  if (get_shader_uniform_id(&prog.uni_mat_model_view, "mat_model_view") != 0)
-    return 1;
-  if (get_shader_uniform_id(&prog.uni_mat_normal, "mat_normal") != 0)
-    return 1;
-  if (get_shader_uniform_id(&prog.uni_color, "color") != 0)
-    return 1;
-  if (get_shader_uniform_id(&prog.uni_light_pos, "light_pos") != 0)
-    return 1;
+  // per-frame uniform buffer, updated once per frame
+  GL_CHECK(glGenBuffers(1, &prog.frame_ubo));
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, prog.frame_ubo));
+  GL_CHECK(glBufferData(GL_UNIFORM_BUFFER, sizeof(struct frame_uniforms), NULL, GL_DYNAMIC_DRAW));
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+  GL_CHECK(glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UBO_BINDING, prog.frame_ubo));
+
+  // per-model uniforms are ranges of a single buffer, respecting the offset alignment
+  GLint align = 0;
+  GL_CHECK(glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align));
+  if (align < 1)
+    align = 1;
+  prog.model_ubo_stride = (sizeof(struct model_uniforms) + align - 1) / align * align;
+  GL_CHECK(glGenBuffers(1, &prog.model_ubo));
 
   vec3_load(prog.light_pos, 0.0, 20.0, 10.0);
   
@@ -116,6 +177,29 @@ static void set_model_color(int n_model, float *color)
   memcpy(models[n_model].color, color, 3*sizeof(float));
 }
 
+static int upload_model_uniforms(void)
+{
+  size_t size = (size_t) prog.model_ubo_stride * (n_models > 0 ? n_models : 1);
+  unsigned char *data = calloc(1, size);
+  if (! data) {
+    debug("* ERROR: out of memory for model uniforms\n");
+    return 1;
+  }
+
+  for (int i = 0; i < n_models; i++) {
+    struct model_uniforms *uni = (struct model_uniforms *) (data + (size_t) i * prog.model_ubo_stride);
+    vec3_copy(uni->color, models[i].color);
+    uni->flat_shading = ! models[i].model.has_normals;
+    models[i].model_ubo_offset = (GLintptr) i * prog.model_ubo_stride;
+  }
+
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, prog.model_ubo));
+  GL_CHECK(glBufferData(GL_UNIFORM_BUFFER, size, data, GL_STATIC_DRAW));
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+  free(data);
+  return 0;
+}
+
 static int init_models(void)
 {
   char **filenames = dir_list_files("maps", ".objc");
@@ -126,11 +210,11 @@ static int init_models(void)
 
   n_models = 0;
   for (int i = 0; filenames[i] != NULL; i++) {
-    struct model_def *def = &models[i];
-    if (++n_models > (int)(sizeof(models)/sizeof(models[0])))
+    if (n_models >= (int)(sizeof(models)/sizeof(models[0])))
       break;
+    struct model_def *def = &models[n_models++];
 
-    if (load_model(&def->model, filenames[i]) != 0) {
+    if (load_model(&def->model, filenames[i], flat_shading) != 0) {
       debug("* ERROR loading model '%s'\n", filenames[i]);
       dir_free_files(filenames);
       return 1;
@@ -143,10 +227,15 @@ static int init_models(void)
     
     GL_CHECK(glGenBuffers(1, &def->vtx_buf_obj));
     GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, def->vtx_buf_obj));
-    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, 2 * 3 * sizeof(GLfloat) * def->model.n_vtx, def->model.vtx, GL_STATIC_DRAW));
-
-    GL_CHECK(glVertexAttribPointer(prog.attr_vtx_pos,    3, GL_FLOAT, GL_FALSE, 2*3*sizeof(GLfloat), NULL));
-    GL_CHECK(glVertexAttribPointer(prog.attr_vtx_normal, 3, GL_FLOAT, GL_FALSE, 2*3*sizeof(GLfloat), (void *) (3*sizeof(GLfloat))));
+    GLsizei vtx_stride = ((def->model.has_normals) ? 2 : 1) * 3 * sizeof(GLfloat);
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, vtx_stride * def->model.n_vtx, def->model.vtx, GL_STATIC_DRAW));
+
+    GL_CHECK(glVertexAttribPointer(prog.attr_vtx_pos, 3, GL_FLOAT, GL_FALSE, vtx_stride, NULL));
+    GL_CHECK(glEnableVertexAttribArray(prog.attr_vtx_pos));
+    if (def->model.has_normals) {
+      GL_CHECK(glVertexAttribPointer(prog.attr_vtx_normal, 3, GL_FLOAT, GL_FALSE, vtx_stride, (void *) (3*sizeof(GLfloat))));
+      GL_CHECK(glEnableVertexAttribArray(prog.attr_vtx_normal));
+    }
     
     GL_CHECK(glGenBuffers(1, &def->index_buf_obj));
     GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, def->index_buf_obj));
@@ -158,13 +247,15 @@ static int init_models(void)
   dir_free_files(filenames);
   
   load_model_colors("model_colors.txt", set_model_color, n_models);
-  return 0;
+  return upload_model_uniforms();
 }
 
 static void reset_viewport(GLFWwindow *window, int width, int height)
 {
   float aspect = (float) width / height;
 
+  viewport_width = width;
+  viewport_height = height;
   glViewport(0, 0, width, height);
   mat4_frustum(mat_projection, -aspect, aspect, -1.0, 1.0, 1.0, 1200.0);
   //float f = 1.3;
@@ -239,25 +330,149 @@ static void toggle_models(int key, int mods)
     models[n_model].disable_draw ^= 1;
 }
 
+static void toggle_stats_log(void)
+{
+  if (stats_get_log_interval() > 0.0) {
+    stats_set_log_interval(0.0);
+    console("stats logging disabled\n");
+  } else {
+    stats_set_log_interval(STATS_LOG_INTERVAL);
+    console("stats logging to out.txt every %g seconds\n", STATS_LOG_INTERVAL);
+  }
+}
+
+static void calc_frustum_planes(float planes[6][4], const float *mat)
+{
+  // each plane is the 4th row of the (row-major) matrix plus or minus one of the other rows
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      planes[2*i+0][j] = mat[12+j] + mat[4*i+j];
+      planes[2*i+1][j] = mat[12+j] - mat[4*i+j];
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    float len = sqrtf(planes[i][0]*planes[i][0] + planes[i][1]*planes[i][1] + planes[i][2]*planes[i][2]);
+    if (len > 0.0) {
+      for (int j = 0; j < 4; j++)
+        planes[i][j] /= len;
+    }
+  }
+}
+
+static int is_model_outside_frustum(float planes[6][4], const struct model *model)
+{
+  for (int i = 0; i < 6; i++) {
+    if (vec3_dot(planes[i], model->center) + planes[i][3] < -model->radius)
+      return 1;
+  }
+  return 0;
+}
+
+static void get_camera_pos(float *pos)
+{
+  if (use_key_cam) {
+    vec3_copy(pos, key_cam.pos);
+  } else {
+    vec3_load_spherical(pos, mouse_cam.radius, mouse_cam.theta, mouse_cam.phi);
+    for (int i = 0; i < 3; i++)
+      pos[i] += mouse_cam.center[i];
+  }
+}
+
+static int compare_visible_models(const void *p1, const void *p2)
+{
+  const struct visible_model *m1 = p1;
+  const struct visible_model *m2 = p2;
+
+  if (m1->dist < m2->dist)
+    return -1;
+  if (m1->dist > m2->dist)
+    return 1;
+  return 0;
+}
+
+/*
+ * Collect the models that should be drawn this frame, sorted
+ * front-to-back by the distance from the camera to the closest point
+ * of their bounding sphere, so that the depth test rejects as many
+ * hidden fragments as possible before shading them.
+ */
+static int get_visible_models(struct visible_model *visible, float frustum_planes[6][4])
+{
+  float cam_pos[3];
+  get_camera_pos(cam_pos);
+
+  int n_visible = 0;
+  for (int i = 0; i < n_models; i++) {
+    struct model_def *def = &models[i];
+    if (def->disable_draw)
+      continue;
+    if (is_model_outside_frustum(frustum_planes, &def->model)) {
+      cur_stats.culled_models++;
+      continue;
+    }
+
+    float d[3] = {
+      def->model.center[0] - cam_pos[0],
+      def->model.center[1] - cam_pos[1],
+      def->model.center[2] - cam_pos[2],
+    };
+    visible[n_visible].def = def;
+    visible[n_visible].dist = sqrtf(vec3_dot(d, d)) - def->model.radius;
+    n_visible++;
+  }
+
+  if (sort_models)
+    qsort(visible, n_visible, sizeof(visible[0]), compare_visible_models);
+  return n_visible;
+}
+
 static void draw_model(struct model_def *def)
 {
-  if (def->disable_draw)
-    return;
-  
   //console("- drawing model: %d triangles, gl buffer ids (%u, %u) \n", def->model.n_tri, def->vtx_buf_obj, def->index_buf_obj);
 
-  vec3_copy(prog.color, def->color);
-  GL_CHECK(glUniform3fv(prog.uni_color, 1, prog.color));
-
   GL_CHECK(glBindVertexArray(def->vtx_array_obj));
-  GL_CHECK(glEnableVertexAttribArray(prog.attr_vtx_pos));
-  GL_CHECK(glEnableVertexAttribArray(prog.attr_vtx_normal));
-  
+  GL_CHECK(glBindBufferRange(GL_UNIFORM_BUFFER, MODEL_UBO_BINDING, prog.model_ubo, def->model_ubo_offset, sizeof(struct model_uniforms)));
   GL_CHECK(glDrawElements(GL_TRIANGLES, 3*def->model.n_tri, GL_UNSIGNED_INT, NULL));
+  cur_stats.draw_calls++;
+  cur_stats.triangles += def->model.n_tri;
   //GL_CHECK(glDrawElements(GL_TRIANGLES, 3*def->model.n_tri, GL_UNSIGNED_INT, def->model.indices));
+}
+
+static void draw_stats(void)
+{
+  static const float color[4] = { 1.0, 1.0, 0.0, 1.0 };
+  const struct frame_stats *s = stats_get_average();
+  float x = 10;
+  float y = 10;
+
+  text_begin(viewport_width, viewport_height);
+
+  text_printf(x, y, color, "frame: %6.2f ms (%.1f fps)", s->frame_time, (s->frame_time > 0.0) ? 1000.0 / s->frame_time : 0.0);
+  y += TEXT_LINE_HEIGHT;
+
+  text_printf(x, y, color, "cpu:   %6.2f ms submitting", s->submit_time);
+  y += TEXT_LINE_HEIGHT;
+
+  if (s->gpu_time[STATS_TIMER_DRAW] >= 0.0)
+    text_printf(x, y, color, "gpu:   %6.2f ms (clear %.2f, draw %.2f, swap %.2f)",
+                s->gpu_time[STATS_TIMER_CLEAR] + s->gpu_time[STATS_TIMER_DRAW] + s->gpu_time[STATS_TIMER_SWAP],
+                s->gpu_time[STATS_TIMER_CLEAR], s->gpu_time[STATS_TIMER_DRAW], s->gpu_time[STATS_TIMER_SWAP]);
+  else
+    text_printf(x, y, color, "gpu:   n/a");
+  y += TEXT_LINE_HEIGHT;
+
+  text_printf(x, y, color, "draw calls: %u, triangles: %u, culled models: %u", s->draw_calls, s->triangles, s->culled_models);
+  y += TEXT_LINE_HEIGHT;
+
+  text_printf(x, y, color, "sort: %s, depth pre-pass: %s%s", (sort_models) ? "front-to-back" : "off",
+              (depth_prepass) ? "on" : "off", (show_overdraw) ? ", showing overdraw" : "");
+  y += TEXT_LINE_HEIGHT;
+
+  if (stats_get_log_interval() > 0.0)
+    text_printf(x, y, color, "logging to out.txt");
 
-  GL_CHECK(glDisableVertexAttribArray(prog.attr_vtx_normal));
-  GL_CHECK(glDisableVertexAttribArray(prog.attr_vtx_pos));
+  text_end();
 }
 
 static void draw_screen(void)
@@ -268,27 +483,77 @@ static void draw_screen(void)
   //console("KEYBOARD MATRIX:\n"); mat4_dump(key_cam.model_view);
 
   // update local uniform values
-  mat4_copy(prog.mat_model_view, (use_key_cam) ? key_cam.matrix : mouse_cam.matrix);
-  mat3_from_mat4(prog.mat_normal, prog.mat_model_view);  // normal = inverse(transpose(model_view))
-  mat4_mul(prog.mat_model_view_projection, mat_projection, prog.mat_model_view);
+  struct frame_uniforms *frame = &prog.frame;
+  float mat_normal[9];
+  mat4_copy(frame->mat_model_view, (use_key_cam) ? key_cam.matrix : mouse_cam.matrix);
+  mat3_from_mat4(mat_normal, frame->mat_model_view);  // normal = inverse(transpose(model_view))
+  mat4_mul(frame->mat_model_view_projection, mat_projection, frame->mat_model_view);
+  for (int i = 0; i < 3; i++)
+    vec3_copy(frame->mat_normal[i], &mat_normal[3*i]);
+  vec3_copy(frame->light_pos, prog.light_pos);
+
+  float frustum_planes[6][4];
+  calc_frustum_planes(frustum_planes, frame->mat_model_view_projection);
+
+  stats_begin_frame(glfwGetTime());
+
+  struct visible_model visible[sizeof(models)/sizeof(models[0])];
+  int n_visible = get_visible_models(visible, frustum_planes);
 
   // render
-  glClearColor(0.0, 0.0, 0.4, 1.0);
+  stats_begin_timer(STATS_TIMER_CLEAR);
+  if (show_overdraw)
+    glClearColor(0.0, 0.0, 0.0, 1.0);
+  else
+    glClearColor(0.0, 0.0, 0.4, 1.0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  stats_end_timer();
   glEnable(GL_DEPTH_TEST);
 
-  GL_CHECK(glUseProgram(prog.prog_id));
-  GL_CHECK(glUniformMatrix4fv(prog.uni_mat_model_view_projection, 1, GL_TRUE, prog.mat_model_view_projection));
-  GL_CHECK(glUniformMatrix4fv(prog.uni_mat_model_view, 1, GL_TRUE, prog.mat_model_view));
-  GL_CHECK(glUniformMatrix3fv(prog.uni_mat_normal, 1, GL_TRUE, prog.mat_normal));
-  GL_CHECK(glUniform3fv(prog.uni_light_pos, 1, prog.light_pos));
+  stats_begin_timer(STATS_TIMER_DRAW);
+
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, prog.frame_ubo));
+  GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(struct frame_uniforms), frame));
+
+  if (depth_prepass) {
+    // fill the depth buffer first, so the main pass only shades visible fragments
+    GL_CHECK(glUseProgram(prog.depth_prog_id));
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    for (int i = 0; i < n_visible; i++)
+      draw_model(visible[i].def);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+  }
 
-  for (int i = 0; i < n_models; i++)
-    draw_model(&models[i]);
+  if (show_overdraw) {
+    // count the fragments shaded at each pixel
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    GL_CHECK(glUseProgram(prog.overdraw_prog_id));
+  } else {
+    GL_CHECK(glUseProgram(prog.prog_id));
+  }
+  for (int i = 0; i < n_visible; i++)
+    draw_model(visible[i].def);
 
+  glDisable(GL_BLEND);
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  GL_CHECK(glBindVertexArray(0));
   GL_CHECK(glUseProgram(0));
-  
+  stats_end_timer();
+
+  if (show_stats)
+    draw_stats();
+
+  stats_end_submit(glfwGetTime());
+
+  stats_begin_timer(STATS_TIMER_SWAP);
   glfwSwapBuffers(window);
+  stats_end_timer();
+
+  stats_end_frame(glfwGetTime());
 }
 
 static void mouse_pos_callback(GLFWwindow *window, double x, double y)
@@ -333,6 +598,26 @@ static void key_callback(GLFWwindow *window, int key, int scancode, int action,
   case GLFW_KEY_F11:
     toggle_fullscreen();
     break;
+
+  case GLFW_KEY_F1:
+    show_stats ^= 1;
+    break;
+
+  case GLFW_KEY_L:
+    toggle_stats_log();
+    break;
+
+  case GLFW_KEY_F2:
+    sort_models ^= 1;
+    break;
+
+  case GLFW_KEY_F3:
+    depth_prepass ^= 1;
+    break;
+
+  case GLFW_KEY_F4:
+    show_overdraw ^= 1;
+    break;
     
   case GLFW_KEY_R:
     reset_view();
@@ -419,6 +704,9 @@ static int init_gfx(void)
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // KHR_debug output is only guaranteed in a debug context; both builds
+  // use the same kind of context so that benchmarks only differ in GL_CHECK
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, (debug_context) ? GL_TRUE : GL_FALSE);
   //glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
   
   window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "DSView", NULL, NULL);
@@ -443,6 +731,38 @@ static int init_gfx(void)
   return 0;
 }
 
+static void run_benchmark(int n_frames)
+{
+  const char *context = (debug_context) ? "debug" : "normal";
+  debug("- Running benchmark (%d frames, GL error checking: %s, %s context)...\n", n_frames, GL_CHECK_MODE, context);
+  glfwSwapInterval(0);
+  for (int i = 0; i < BENCH_WARMUP_FRAMES; i++) {
+    glfwPollEvents();
+    draw_screen();
+  }
+
+  stats_reset_totals();
+  double start = glfwGetTime();
+  for (int i = 0; i < n_frames && handle_events() == 0; i++)
+    draw_screen();
+  double elapsed = glfwGetTime() - start;
+
+  struct frame_stats s;
+  unsigned int n_done;
+  stats_get_totals(&s, &n_done);
+  if (n_done == 0)
+    return;
+
+  double gpu_time = 0.0;
+  for (int i = 0; i < STATS_NUM_TIMERS; i++)
+    gpu_time += s.gpu_time[i];
+
+  const char *fmt = "benchmark (GL error checking: %s, %s context): %u frames in %.3f s, %.3f ms/frame (%.1f fps), cpu submit %.3f ms/frame, gpu %.3f ms/frame, %u draw calls/frame\n";
+  double frame_time = elapsed * 1000.0 / n_done;
+  console(fmt, GL_CHECK_MODE, context, n_done, elapsed, frame_time, 1000.0 / frame_time, s.submit_time, gpu_time, s.draw_calls);
+  debug(fmt, GL_CHECK_MODE, context, n_done, elapsed, frame_time, 1000.0 / frame_time, s.submit_time, gpu_time, s.draw_calls);
+}
+
 static void cleanup_gfx(void)
 {
   glfwTerminate();
@@ -450,17 +770,42 @@ static void cleanup_gfx(void)
 
 int main(int argc, char* argv[])
 {
+  int bench_frames = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0) {
+      flat_shading = 1;
+    } else if (strcmp(argv[i], "-n") == 0) {
+      debug_context = 0;
+    } else if (strcmp(argv[i], "-b") == 0) {
+      bench_frames = BENCH_DEFAULT_FRAMES;
+      if (i+1 < argc && argv[i+1][0] != '-')
+        bench_frames = atoi(argv[++i]);
+    } else {
+      console("USAGE: %s [-f] [-n] [-b [frames]]\n", argv[0]);
+      console("  -f   flat shading: derive normals in the shader, don't load them\n");
+      console("  -n   use a normal OpenGL context instead of a debug context\n");
+      console("  -b   benchmark: draw a number of frames and report timings\n");
+      return 1;
+    }
+  }
+  if (bench_frames < 0)
+    bench_frames = 0;
+
   init_debug();
 
   debug("- Initializing GFX...\n");
   if (init_gfx() != 0)
     return 1;
+  init_gl_debug_output();
 
   int ret = 1;
 
   debug("- Loading shaders...\n");
   if (init_shaders() != 0)
     goto err;
+  if (init_text() != 0)
+    goto err;
+  init_stats();
   
   debug("- Loading models...\n");
   if (init_models() != 0)
@@ -474,10 +819,14 @@ int main(int argc, char* argv[])
   reset_mouse_pointer();
   draw_screen();
 
-  debug("- Running main loop...\n");
-  while (handle_events() == 0) {
-    process_movement();
-    draw_screen();
+  if (bench_frames > 0) {
+    run_benchmark(bench_frames);
+  } else {
+    debug("- Running main loop...\n");
+    while (handle_events() == 0) {
+      process_movement();
+      draw_screen();
+    }
   }
   ret = 0;
 
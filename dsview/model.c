@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <limits.h>
+#include <math.h>
 
 #include "model.h"
 #include "debug.h"
@@ -19,7 +20,54 @@ static int read_u32_le(FILE *f, uint32_t *v)
   return 0;
 }
 
-int load_model(struct model *model, const char *filename)
+static long get_file_size(FILE *f)
+{
+  if (fseek(f, 0, SEEK_END) != 0)
+    return -1;
+  long size = ftell(f);
+  if (fseek(f, 0, SEEK_SET) != 0)
+    return -1;
+  return size;
+}
+
+static void calc_bounding_sphere(struct model *model)
+{
+  float min[3] = {  HUGE_VALF,  HUGE_VALF,  HUGE_VALF };
+  float max[3] = { -HUGE_VALF, -HUGE_VALF, -HUGE_VALF };
+
+  int vtx_floats = (model->has_normals) ? 2*3 : 3;
+
+  for (uint32_t i = 0; i < model->n_vtx; i++) {
+    float *v = &model->vtx[vtx_floats*i];
+    for (int j = 0; j < 3; j++) {
+      if (min[j] > v[j]) min[j] = v[j];
+      if (max[j] < v[j]) max[j] = v[j];
+    }
+  }
+  for (int j = 0; j < 3; j++)
+    model->center[j] = (model->n_vtx > 0) ? (min[j] + max[j]) / 2 : 0.0;
+
+  float radius2 = 0.0;
+  for (uint32_t i = 0; i < model->n_vtx; i++) {
+    float *v = &model->vtx[vtx_floats*i];
+    float dx = v[0] - model->center[0];
+    float dy = v[1] - model->center[1];
+    float dz = v[2] - model->center[2];
+    float d2 = dx*dx + dy*dy + dz*dz;
+    if (radius2 < d2)
+      radius2 = d2;
+  }
+  model->radius = sqrtf(radius2);
+}
+
+/*
+ * The .objc layout is:
+ *   u32 n_vtx, u32 n_tri, n_vtx vertices, n_tri*3 u32 indices
+ * where each vertex is either 3 floats (position) or 6 floats
+ * (position followed by normal).  The two variants are told apart by
+ * the file size.
+ */
+int load_model(struct model *model, const char *filename, int skip_normals)
 {
   FILE *f = fopen(filename, "rb");
   if (! f)
@@ -28,27 +76,50 @@ int load_model(struct model *model, const char *filename)
   model->vtx = NULL;
   model->indices = NULL;
 
+  long file_size = get_file_size(f);
+  if (file_size < 0)
+    goto err;
+
   if (read_u32_le(f, &model->n_vtx) != 0 || model->n_vtx > INT_MAX)
     goto err;
   
   if (read_u32_le(f, &model->n_tri) != 0 || model->n_tri > INT_MAX)
     goto err;
 
-  size_t vtx_size = 2 * 3 * 4 * model->n_vtx;
+  size_t pos_size = 3 * 4 * (size_t) model->n_vtx;
+  size_t indices_size = 3 * 4 * (size_t) model->n_tri;
+  if ((size_t) file_size == 8 + pos_size + indices_size)
+    model->has_normals = 0;
+  else if ((size_t) file_size == 8 + 2 * pos_size + indices_size)
+    model->has_normals = 1;
+  else
+    goto err;
+
+  size_t vtx_size = (model->has_normals) ? 2 * pos_size : pos_size;
   model->vtx = malloc(vtx_size);
   if (! model->vtx)
     goto err;
   if (fread(model->vtx, 1, vtx_size, f) != vtx_size)
     goto err;
 
-  size_t indices_size = 3 * 4 * model->n_tri;
+  // drop the normal half of each interleaved vertex
+  if (model->has_normals && skip_normals) {
+    for (uint32_t i = 0; i < model->n_vtx; i++)
+      memmove(&model->vtx[3*i], &model->vtx[2*3*i], 3 * sizeof(float));
+    float *vtx = realloc(model->vtx, pos_size);
+    if (vtx)
+      model->vtx = vtx;
+    model->has_normals = 0;
+  }
+
   model->indices = malloc(indices_size);
   if (! model->indices)
     goto err;
   if (fread(model->indices, 1, indices_size, f) != indices_size)
     goto err;
   
-  debug("  - %u verts, %u triangles\n", model->n_vtx, model->n_tri);
+  calc_bounding_sphere(model);
+  debug("  - %u verts, %u triangles%s\n", model->n_vtx, model->n_tri, (model->has_normals) ? "" : ", no normals");
   
   fclose(f);
   return 0;
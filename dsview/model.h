@@ -9,11 +9,16 @@ struct model {
   uint32_t n_vtx;
   uint32_t n_tri;
   
+  int has_normals;  // vtx is interleaved position+normal if set, positions only if not
   float *vtx;
   uint32_t *indices;
+
+  // bounding sphere
+  float center[3];
+  float radius;
 };
 
-int load_model(struct model *model, const char *filename);
+int load_model(struct model *model, const char *filename, int skip_normals);
 int load_model_colors(const char *filename, void (*set_color)(int num, float *color), int max_colors);
 
 #endif /* MODEL_H_FILE */
@@ -0,0 +1,8 @@
+#version 150
+
+out vec3 frag;
+
+// drawn with additive blending: red saturates after 8 layers, green after 16, blue after 32
+void main() {
+  frag = vec3(0.125, 0.0625, 0.03125);
+}
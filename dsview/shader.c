@@ -119,7 +119,12 @@ static GLuint load_shader_file(GLenum type, const char *filename)
   return 0;
 }
 
-GLuint load_program_shader(const char *vert_filename, const char *frag_filename)
+/*
+ * If attr_names is not NULL, it's a NULL-terminated list of vertex
+ * attribute names that get bound to locations 0, 1, ... before
+ * linking, so that programs sharing a vertex shader can share VAOs.
+ */
+GLuint load_program_shader_attribs(const char *vert_filename, const char *frag_filename, const char *const *attr_names)
 {
   GLuint prog_id = 0;
   GLuint vert_shader_id = 0;
@@ -141,6 +146,10 @@ GLuint load_program_shader(const char *vert_filename, const char *frag_filename)
     goto err;
   glAttachShader(prog_id, frag_shader_id);
 
+  // bind attribute locations
+  for (GLuint i = 0; attr_names && attr_names[i] != NULL; i++)
+    glBindAttribLocation(prog_id, i, attr_names[i]);
+
   // link program
   glLinkProgram(prog_id);
   GLint ok = GL_FALSE;
@@ -162,3 +171,8 @@ GLuint load_program_shader(const char *vert_filename, const char *frag_filename)
     glDeleteShader(frag_shader_id);
   return 0;
 }
+
+GLuint load_program_shader(const char *vert_filename, const char *frag_filename)
+{
+  return load_program_shader_attribs(vert_filename, frag_filename, NULL);
+}
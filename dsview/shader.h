@@ -6,5 +6,6 @@
 #include <glad/glad.h>
 
 GLuint load_program_shader(const char *vert_filename, const char *frag_filename);
+GLuint load_program_shader_attribs(const char *vert_filename, const char *frag_filename, const char *const *attr_names);
 
 #endif /* SHADER_H_FILE */
@@ -0,0 +1,193 @@
+/* stats.c */
+
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include "stats.h"
+#include "gl_error.h"
+#include "debug.h"
+
+#define AVERAGE_INTERVAL  0.5   // seconds between updates of the average stats
+#define NUM_QUERY_SETS    2     // frames in flight before reading back query results
+
+struct frame_stats cur_stats;
+
+struct stats_acc {
+  unsigned int n_frames;
+  unsigned int n_gpu_frames;
+  struct frame_stats sum;
+};
+
+static struct {
+  int has_timer_query;
+  GLuint queries[NUM_QUERY_SETS][STATS_NUM_TIMERS];
+  int query_pending[NUM_QUERY_SETS];
+  int cur_set;
+  int timers_active;
+
+  double frame_start;
+  double avg_start;
+  double log_interval;
+  double last_log;
+
+  struct stats_acc window;  // accumulated since avg_start
+  struct stats_acc total;   // accumulated since stats_reset_totals()
+  struct frame_stats avg;
+} stats;
+
+void init_stats(void)
+{
+  memset(&stats, 0, sizeof(stats));
+  memset(&cur_stats, 0, sizeof(cur_stats));
+  stats.frame_start = -1.0;
+  for (int i = 0; i < STATS_NUM_TIMERS; i++)
+    stats.avg.gpu_time[i] = -1.0;
+
+  stats.has_timer_query = GLAD_GL_ARB_timer_query;
+  if (! stats.has_timer_query) {
+    debug("* WARNING: GL_ARB_timer_query not supported, GPU times will not be available\n");
+    return;
+  }
+  for (int i = 0; i < NUM_QUERY_SETS; i++)
+    GL_CHECK(glGenQueries(STATS_NUM_TIMERS, stats.queries[i]));
+}
+
+void stats_set_log_interval(double interval)
+{
+  stats.log_interval = interval;
+}
+
+double stats_get_log_interval(void)
+{
+  return stats.log_interval;
+}
+
+/*
+ * Read the results of the query set we're about to reuse.  Since it
+ * was issued NUM_QUERY_SETS frames ago the results are normally
+ * available, but if they're not we skip timing this frame instead of
+ * stalling the pipeline waiting for them.
+ */
+static int read_query_set(int set)
+{
+  if (! stats.query_pending[set])
+    return 0;
+
+  GLint available = 0;
+  GL_CHECK(glGetQueryObjectiv(stats.queries[set][STATS_NUM_TIMERS-1], GL_QUERY_RESULT_AVAILABLE, &available));
+  if (! available)
+    return 1;
+
+  for (int i = 0; i < STATS_NUM_TIMERS; i++) {
+    GLuint64 elapsed = 0;
+    GL_CHECK(glGetQueryObjectui64v(stats.queries[set][i], GL_QUERY_RESULT, &elapsed));
+    stats.window.sum.gpu_time[i] += elapsed / 1000000.0;
+    stats.total.sum.gpu_time[i] += elapsed / 1000000.0;
+  }
+  stats.window.n_gpu_frames++;
+  stats.total.n_gpu_frames++;
+  stats.query_pending[set] = 0;
+  return 0;
+}
+
+void stats_begin_frame(double time)
+{
+  if (stats.frame_start >= 0.0)
+    cur_stats.frame_time = (time - stats.frame_start) * 1000.0;
+  stats.frame_start = time;
+  cur_stats.submit_time = 0.0;
+  cur_stats.draw_calls = 0;
+  cur_stats.triangles = 0;
+  cur_stats.culled_models = 0;
+
+  stats.timers_active = 0;
+  if (stats.has_timer_query) {
+    stats.cur_set = (stats.cur_set + 1) % NUM_QUERY_SETS;
+    stats.timers_active = (read_query_set(stats.cur_set) == 0);
+  }
+}
+
+void stats_begin_timer(int timer)
+{
+  if (stats.timers_active)
+    GL_CHECK(glBeginQuery(GL_TIME_ELAPSED, stats.queries[stats.cur_set][timer]));
+}
+
+void stats_end_timer(void)
+{
+  if (stats.timers_active)
+    GL_CHECK(glEndQuery(GL_TIME_ELAPSED));
+}
+
+void stats_end_submit(double time)
+{
+  cur_stats.submit_time = (time - stats.frame_start) * 1000.0;
+}
+
+static void add_frame(struct stats_acc *acc)
+{
+  acc->n_frames++;
+  acc->sum.frame_time += cur_stats.frame_time;
+  acc->sum.submit_time += cur_stats.submit_time;
+  acc->sum.draw_calls += cur_stats.draw_calls;
+  acc->sum.triangles += cur_stats.triangles;
+  acc->sum.culled_models += cur_stats.culled_models;
+}
+
+static void calc_average(struct frame_stats *avg, const struct stats_acc *acc)
+{
+  unsigned int n = (acc->n_frames > 0) ? acc->n_frames : 1;
+
+  avg->frame_time = acc->sum.frame_time / n;
+  avg->submit_time = acc->sum.submit_time / n;
+  avg->draw_calls = acc->sum.draw_calls / n;
+  avg->triangles = acc->sum.triangles / n;
+  avg->culled_models = acc->sum.culled_models / n;
+  for (int i = 0; i < STATS_NUM_TIMERS; i++)
+    avg->gpu_time[i] = (acc->n_gpu_frames > 0) ? acc->sum.gpu_time[i] / acc->n_gpu_frames : -1.0;
+}
+
+static void log_stats(const struct frame_stats *s)
+{
+  debug("stats: frame %.3f ms, submit %.3f ms, gpu clear %.3f ms, draw %.3f ms, swap %.3f ms, %u draw calls, %u triangles, %u culled models\n",
+        s->frame_time, s->submit_time, s->gpu_time[STATS_TIMER_CLEAR], s->gpu_time[STATS_TIMER_DRAW], s->gpu_time[STATS_TIMER_SWAP],
+        s->draw_calls, s->triangles, s->culled_models);
+}
+
+void stats_end_frame(double time)
+{
+  if (stats.timers_active)
+    stats.query_pending[stats.cur_set] = 1;
+
+  add_frame(&stats.window);
+  add_frame(&stats.total);
+
+  if (time - stats.avg_start >= AVERAGE_INTERVAL) {
+    calc_average(&stats.avg, &stats.window);
+    memset(&stats.window, 0, sizeof(stats.window));
+    stats.avg_start = time;
+  }
+
+  if (stats.log_interval > 0.0 && time - stats.last_log >= stats.log_interval) {
+    log_stats(&stats.avg);
+    stats.last_log = time;
+  }
+}
+
+const struct frame_stats *stats_get_average(void)
+{
+  return &stats.avg;
+}
+
+void stats_reset_totals(void)
+{
+  memset(&stats.total, 0, sizeof(stats.total));
+}
+
+void stats_get_totals(struct frame_stats *avg, unsigned int *p_n_frames)
+{
+  calc_average(avg, &stats.total);
+  if (p_n_frames)
+    *p_n_frames = stats.total.n_frames;
+}
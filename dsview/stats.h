@@ -0,0 +1,36 @@
+/* stats.h */
+
+#ifndef STATS_H_FILE
+#define STATS_H_FILE
+
+#define STATS_TIMER_CLEAR  0
+#define STATS_TIMER_DRAW   1
+#define STATS_TIMER_SWAP   2
+#define STATS_NUM_TIMERS   3
+
+struct frame_stats {
+  double frame_time;                  // CPU time between frames (ms)
+  double submit_time;                 // CPU time spent issuing the frame's GL commands (ms)
+  double gpu_time[STATS_NUM_TIMERS];  // GPU time of each frame section (ms), < 0 if unavailable
+  unsigned int draw_calls;
+  unsigned int triangles;
+  unsigned int culled_models;
+};
+
+extern struct frame_stats cur_stats;
+
+void init_stats(void);
+void stats_set_log_interval(double interval);
+double stats_get_log_interval(void);
+
+void stats_begin_frame(double time);
+void stats_begin_timer(int timer);
+void stats_end_timer(void);
+void stats_end_submit(double time);
+void stats_end_frame(double time);
+
+const struct frame_stats *stats_get_average(void);
+void stats_reset_totals(void);
+void stats_get_totals(struct frame_stats *avg, unsigned int *p_n_frames);
+
+#endif /* STATS_H_FILE */
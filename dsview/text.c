@@ -0,0 +1,176 @@
+/* text.c */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+#include <glad/glad.h>
+
+#include "text.h"
+#include "font.h"
+#include "shader.h"
+#include "gl_error.h"
+#include "debug.h"
+
+#define MAX_TEXT_LEN  256
+
+#define CELL_WIDTH    (FONT_CHAR_WIDTH + 1)
+#define TEX_WIDTH     (FONT_NUM_CHARS * CELL_WIDTH)
+#define TEX_HEIGHT    FONT_CHAR_HEIGHT
+
+struct text_vertex {
+  float pos[2];
+  float uv[2];
+};
+
+struct text_program {
+  GLuint prog_id;
+
+  GLint attr_vtx_pos;
+  GLint attr_vtx_uv;
+
+  GLint uni_screen_size;
+  GLint uni_color;
+  GLint uni_font_tex;
+
+  GLuint font_tex;
+  GLuint vtx_array_obj;
+  GLuint vtx_buf_obj;
+  float screen_size[2];
+};
+static struct text_program text;
+
+static struct text_vertex text_vtx[6 * MAX_TEXT_LEN];
+
+static int init_font_texture(void)
+{
+  static unsigned char pixels[TEX_HEIGHT][TEX_WIDTH];
+
+  for (int ch = 0; ch < FONT_NUM_CHARS; ch++) {
+    for (int x = 0; x < FONT_CHAR_WIDTH; x++) {
+      for (int y = 0; y < FONT_CHAR_HEIGHT; y++)
+        pixels[y][ch*CELL_WIDTH + x] = (font_data[ch][x] & (1<<y)) ? 255 : 0;
+    }
+  }
+
+  GL_CHECK(glGenTextures(1, &text.font_tex));
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D, text.font_tex));
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, TEX_WIDTH, TEX_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, pixels));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+  return 0;
+}
+
+int init_text(void)
+{
+  text.prog_id = load_program_shader("text_vert.shader", "text_frag.shader");
+  if (text.prog_id == 0)
+    return 1;
+
+  text.attr_vtx_pos = glGetAttribLocation(text.prog_id, "vtx_pos");
+  text.attr_vtx_uv = glGetAttribLocation(text.prog_id, "vtx_uv");
+  text.uni_screen_size = glGetUniformLocation(text.prog_id, "screen_size");
+  text.uni_color = glGetUniformLocation(text.prog_id, "color");
+  text.uni_font_tex = glGetUniformLocation(text.prog_id, "font_tex");
+  GL_CHECK_ERRORS();
+  if (text.attr_vtx_pos < 0 || text.attr_vtx_uv < 0) {
+    debug("* ERROR: can't read text shader attributes\n");
+    return 1;
+  }
+
+  if (init_font_texture() != 0)
+    return 1;
+
+  GL_CHECK(glGenVertexArrays(1, &text.vtx_array_obj));
+  GL_CHECK(glBindVertexArray(text.vtx_array_obj));
+
+  GL_CHECK(glGenBuffers(1, &text.vtx_buf_obj));
+  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, text.vtx_buf_obj));
+  GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(text_vtx), NULL, GL_STREAM_DRAW));
+
+  GL_CHECK(glVertexAttribPointer(text.attr_vtx_pos, 2, GL_FLOAT, GL_FALSE, sizeof(struct text_vertex), (void *) offsetof(struct text_vertex, pos)));
+  GL_CHECK(glVertexAttribPointer(text.attr_vtx_uv,  2, GL_FLOAT, GL_FALSE, sizeof(struct text_vertex), (void *) offsetof(struct text_vertex, uv)));
+  GL_CHECK(glEnableVertexAttribArray(text.attr_vtx_pos));
+  GL_CHECK(glEnableVertexAttribArray(text.attr_vtx_uv));
+
+  GL_CHECK(glBindVertexArray(0));
+  return 0;
+}
+
+void text_begin(int screen_width, int screen_height)
+{
+  text.screen_size[0] = screen_width;
+  text.screen_size[1] = screen_height;
+
+  glDisable(GL_DEPTH_TEST);
+  GL_CHECK(glUseProgram(text.prog_id));
+  GL_CHECK(glUniform2fv(text.uni_screen_size, 1, text.screen_size));
+  GL_CHECK(glUniform1i(text.uni_font_tex, 0));
+  GL_CHECK(glActiveTexture(GL_TEXTURE0));
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D, text.font_tex));
+  GL_CHECK(glBindVertexArray(text.vtx_array_obj));
+  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, text.vtx_buf_obj));
+}
+
+static void add_char_quad(struct text_vertex *v, float x, float y, int ch)
+{
+  float w = FONT_CHAR_WIDTH * TEXT_SCALE;
+  float h = FONT_CHAR_HEIGHT * TEXT_SCALE;
+  float u0 = (float) (ch * CELL_WIDTH) / TEX_WIDTH;
+  float u1 = (float) (ch * CELL_WIDTH + FONT_CHAR_WIDTH) / TEX_WIDTH;
+
+  struct text_vertex quad[6] = {
+    { { x,   y   }, { u0, 0.0 } },
+    { { x+w, y   }, { u1, 0.0 } },
+    { { x+w, y+h }, { u1, 1.0 } },
+    { { x,   y   }, { u0, 0.0 } },
+    { { x+w, y+h }, { u1, 1.0 } },
+    { { x,   y+h }, { u0, 1.0 } },
+  };
+  for (int i = 0; i < 6; i++)
+    v[i] = quad[i];
+}
+
+void text_printf(float x, float y, const float *color, const char *fmt, ...)
+{
+  char str[MAX_TEXT_LEN];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(str, sizeof(str), fmt, ap);
+  va_end(ap);
+
+  int n_chars = 0;
+  float start_x = x;
+  for (const char *p = str; *p != '\0'; p++) {
+    if (*p == '\n') {
+      x = start_x;
+      y += TEXT_LINE_HEIGHT;
+      continue;
+    }
+    int ch = (unsigned char) *p - FONT_FIRST_CHAR;
+    if (ch < 0 || ch >= FONT_NUM_CHARS)
+      ch = '?' - FONT_FIRST_CHAR;
+    if (ch != 0)
+      add_char_quad(&text_vtx[6*n_chars++], x, y, ch);
+    x += CELL_WIDTH * TEXT_SCALE;
+  }
+  if (n_chars == 0)
+    return;
+
+  GL_CHECK(glUniform4fv(text.uni_color, 1, color));
+  GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, 6 * n_chars * sizeof(struct text_vertex), text_vtx));
+  GL_CHECK(glDrawArrays(GL_TRIANGLES, 0, 6 * n_chars));
+}
+
+void text_end(void)
+{
+  GL_CHECK(glBindVertexArray(0));
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D, 0));
+  GL_CHECK(glUseProgram(0));
+  glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,14 @@
+/* text.h */
+
+#ifndef TEXT_H_FILE
+#define TEXT_H_FILE
+
+#define TEXT_SCALE       2
+#define TEXT_LINE_HEIGHT (TEXT_SCALE * 10)
+
+int init_text(void);
+void text_begin(int screen_width, int screen_height);
+void text_printf(float x, float y, const float *color, const char *fmt, ...) __attribute__((format(printf, 4, 5)));
+void text_end(void);
+
+#endif /* TEXT_H_FILE */
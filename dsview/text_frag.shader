@@ -0,0 +1,13 @@
+#version 150
+
+in vec2 frag_uv;
+
+out vec4 frag;
+uniform sampler2D font_tex;
+uniform vec4 color;
+
+void main() {
+  if (texture(font_tex, frag_uv).r < 0.5)
+    discard;
+  frag = color;
+}
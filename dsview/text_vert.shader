@@ -0,0 +1,13 @@
+#version 150
+
+in vec2 vtx_pos;
+in vec2 vtx_uv;
+
+out vec2 frag_uv;
+
+uniform vec2 screen_size;
+
+void main() {
+  frag_uv = vtx_uv;
+  gl_Position = vec4(2.0*vtx_pos.x/screen_size.x - 1.0, 1.0 - 2.0*vtx_pos.y/screen_size.y, 0.0, 1.0);
+}
@@ -6,12 +6,18 @@ in vec3 vtx_normal;
 varying vec3 frag_pos;
 varying vec3 frag_normal;
 
-uniform mat4 mat_model_view_projection;
-uniform mat4 mat_model_view;
-uniform mat3 mat_normal;
+// the depth pre-pass and the main pass must produce the same depth
+invariant gl_Position;
+
+layout(std140, row_major) uniform frame_data {
+  mat4 mat_model_view_projection;
+  mat4 mat_model_view;
+  mat3 mat_normal;
+  vec3 light_pos;
+};
 
 void main() {
-  frag_normal = normalize(mat_normal * vtx_normal);
+  frag_normal = mat_normal * vtx_normal;  // normalized in the fragment shader
   frag_pos = vec3(mat_model_view * vec4(vtx_pos, 1.0));
   gl_Position = mat_model_view_projection * vec4(vtx_pos, 1.0);
 }
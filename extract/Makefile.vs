@@ -8,18 +8,24 @@ LIBS = $(DEVROOT)\vs-lib\zlibstatic.lib
 all: dcxtool.exe bndtool.exe bhdtool.exe hkxtool.exe dump_nvm.exe
 
 clean:
-	-del *.obj dcxtool.exe bndtool.exe bhdtool.exe hkxtool.exe dump_nvm.exe
+	-del *.obj dcxtool.exe bndtool.exe bhdtool.exe hkxtool.exe dump_nvm.exe bnd_bench.exe
 
-dcxtool.exe: dcxtool.obj dcx.obj reader.obj
+bench: bnd_bench.exe
+	bnd_bench.exe
+
+dcxtool.exe: dcxtool.obj dcx.obj cache.obj hash.obj inflate.obj thread.obj reader.obj util.obj verify.obj
+	$(CC) $(LDFLAGS) -Fe$@ $** $(LIBS)
+
+bndtool.exe: bndtool.obj bnd.obj name_index.obj pack.obj sched.obj writer.obj dcx.obj cache.obj hash.obj inflate.obj thread.obj reader.obj dump.obj util.obj verify.obj
 	$(CC) $(LDFLAGS) -Fe$@ $** $(LIBS)
 
-bndtool.exe: bndtool.obj bnd.obj dcx.obj reader.obj dump.obj util.obj
+bhdtool.exe: bhdtool.obj bhd.obj name_index.obj pack.obj sched.obj writer.obj dcx.obj cache.obj hash.obj inflate.obj thread.obj reader.obj dump.obj util.obj verify.obj
 	$(CC) $(LDFLAGS) -Fe$@ $** $(LIBS)
 
-bhdtool.exe: bhdtool.obj bhd.obj dcx.obj reader.obj dump.obj util.obj
+hkxtool.exe: hkxtool.obj hkx.obj walk.obj bnd.obj bhd.obj name_index.obj pack.obj sched.obj dcx.obj cache.obj hash.obj inflate.obj thread.obj reader.obj dump.obj util.obj
 	$(CC) $(LDFLAGS) -Fe$@ $** $(LIBS)
 
-hkxtool.exe: hkxtool.obj hkx.obj bhd.obj dcx.obj reader.obj dump.obj
+bnd_bench.exe: bnd_bench.obj bnd.obj name_index.obj pack.obj dcx.obj cache.obj hash.obj inflate.obj thread.obj reader.obj util.obj
 	$(CC) $(LDFLAGS) -Fe$@ $** $(LIBS)
 
 dump_nvm.exe: dump_nvm.obj
@@ -8,33 +8,142 @@
 #include "bhd.h"
 #include "reader.h"
 
+#define BHD5_FILE_DEF_SIZE  0x10
+
 static char *get_bdt_filename(const char *bhd_filename)
 {
   size_t len = strlen(bhd_filename);
   if (len < 3)
     return NULL;
-  
+
   char *bdt_filename = malloc(len+1);
   if (! bdt_filename)
     return NULL;
-  
+
   strcpy(bdt_filename, bhd_filename);
-  strcpy(bdt_filename + len - 3, "bdt");
+  if (len >= 4 && strcmp(bdt_filename + len - 4, "bhd5") == 0)
+    strcpy(bdt_filename + len - 4, "bdt");
+  else
+    strcpy(bdt_filename + len - 3, "bdt");
   return bdt_filename;
 }
 
-int bhd_open(struct BHD_FILE *f, const char *bhd_filename)
+static void init_bhd(struct BHD_FILE *f)
 {
   f->bhd = NULL;
+  f->bhd_size = 0;
   f->bdt = NULL;
+  f->bdt_size = 0;
+  f->owns_data = false;
+  f->version = 3;
+  f->n_files = 0;
+  name_index_init(&f->index);
+  f->big_endian = false;
+  f->n_buckets = 0;
+  f->bucket_first = NULL;
+  f->file_defs = NULL;
+  f->names = NULL;
+  f->names_buf = NULL;
+  f->names_list = NULL;
+  f->bdt_fd = -1;
+  f->file_buf = NULL;
+  f->file_buf_size = 0;
+}
+
+static uint32_t read_u32(struct BHD_FILE *f, uint64_t offset)
+{
+  if (offset > f->bhd_size || f->bhd_size - offset < 4)
+    return 0;
+
+  if (f->big_endian)
+    return get_u32_be(f->bhd, offset);
+  else
+    return get_u32_le(f->bhd, offset);
+}
+
+static uint64_t read_u64(struct BHD_FILE *f, uint64_t offset)
+{
+  uint64_t lo = read_u32(f, offset + (f->big_endian ? 4 : 0));
+  uint64_t hi = read_u32(f, offset + (f->big_endian ? 0 : 4));
+  return hi << 32 | lo;
+}
+
+/*
+ * Read the BHD5 buckets: each bucket is {n_files, file_defs_offset}, and
+ * each file definition is {hash, size, offset (64 bit)}.
+ */
+static int read_bhd5(struct BHD_FILE *f)
+{
+  if (f->bhd_size < 0x18)
+    return 1;
+  f->version = 5;
+  f->big_endian = (get_u8(f->bhd, 4) == 0);
+  f->n_buckets = read_u32(f, 0x10);
+  uint32_t buckets_off = read_u32(f, 0x14);
+  if (f->n_buckets == 0 || buckets_off > f->bhd_size || (f->bhd_size - buckets_off) / 8 < f->n_buckets)
+    return 1;
+
+  uint64_t n_files = 0;
+  for (uint32_t bucket = 0; bucket < f->n_buckets; bucket++) {
+    uint32_t n = read_u32(f, buckets_off + 8 * (uint64_t) bucket);
+    uint32_t defs_off = read_u32(f, buckets_off + 8 * (uint64_t) bucket + 4);
+    if (defs_off > f->bhd_size || (f->bhd_size - defs_off) / BHD5_FILE_DEF_SIZE < n)
+      return 1;
+    n_files += n;
+  }
+  if (n_files > f->bhd_size / BHD5_FILE_DEF_SIZE)
+    return 1;
+  f->n_files = n_files;
+
+  f->bucket_first = malloc((f->n_buckets + 1) * sizeof(uint32_t));
+  f->file_defs = malloc((f->n_files + 1) * sizeof(uint32_t));
+  f->names = malloc((f->n_files + 1) * sizeof(char *));
+  f->names_buf = malloc(f->n_files * 16 + 1);
+  if (! f->bucket_first || ! f->file_defs || ! f->names || ! f->names_buf)
+    return 1;
+
+  uint32_t file_num = 0;
+  for (uint32_t bucket = 0; bucket < f->n_buckets; bucket++) {
+    uint32_t n = read_u32(f, buckets_off + 8 * (uint64_t) bucket);
+    uint32_t defs_off = read_u32(f, buckets_off + 8 * (uint64_t) bucket + 4);
+    f->bucket_first[bucket] = file_num;
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t def = defs_off + i * BHD5_FILE_DEF_SIZE;
+      f->file_defs[file_num] = def;
+      f->names[file_num] = f->names_buf + file_num * 16;
+      snprintf(f->names[file_num], 16, "%08x.dat", (unsigned) read_u32(f, def));
+      file_num++;
+    }
+  }
+  f->bucket_first[f->n_buckets] = file_num;
+  return 0;
+}
+
+int bhd_open(struct BHD_FILE *f, const char *bhd_filename)
+{
+  init_bhd(f);
 
   char *bdt_filename = get_bdt_filename(bhd_filename);
   if (! bdt_filename)
     goto err;
 
   f->bhd = read_file(bhd_filename, &f->bhd_size);
+  f->owns_data = true;
   if (f->bhd == NULL || f->bhd_size < 32)
     goto err;
+
+  if (memcmp(f->bhd, "BHD5", 4) == 0) {
+    // the BDT may be huge, so files are read from it when needed
+    if (read_bhd5(f) != 0)
+      goto err;
+    if (get_file_size(bdt_filename, &f->bdt_size) != 0)
+      goto err;
+    f->bdt_fd = file_open_read(bdt_filename);
+    if (f->bdt_fd < 0)
+      goto err;
+    free(bdt_filename);
+    return 0;
+  }
   if (memcmp(f->bhd, "BHF3", 4) != 0)
     goto err;
 
@@ -45,33 +154,336 @@ int bhd_open(struct BHD_FILE *f, const char *bhd_filename)
     goto err;
 
   f->n_files = get_u32_le(f->bhd, 16);
-  
+
   free(bdt_filename);
   return 0;
 
  err:
   free(bdt_filename);
-  free(f->bhd);
-  free(f->bdt);
+  bhd_close(f);
   return 1;
 }
 
+/*
+ * Open a BHD/BDT pair from memory.  The data is used in place and must
+ * stay valid until bhd_close().  Only BHF3/BDF3 is supported.
+ */
+int bhd_open_mem(struct BHD_FILE *f, const void *bhd, size_t bhd_size, const void *bdt, size_t bdt_size)
+{
+  init_bhd(f);
+  if (bhd_size < 32 || memcmp(bhd, "BHF3", 4) != 0)
+    return 1;
+  if (bdt_size < 16 || memcmp(bdt, "BDF3", 4) != 0)
+    return 1;
+
+  f->bhd = (void *) bhd;
+  f->bhd_size = bhd_size;
+  f->bdt = (void *) bdt;
+  f->bdt_size = bdt_size;
+  f->owns_data = false;
+  f->n_files = get_u32_le(f->bhd, 16);
+  return 0;
+}
+
 void bhd_close(struct BHD_FILE *f)
 {
-  free(f->bhd);
-  free(f->bdt);
+  if (f->owns_data) {
+    free(f->bhd);
+    free(f->bdt);
+  }
   f->bhd = NULL;
   f->bdt = NULL;
+  name_index_free(&f->index);
+  free(f->bucket_first);
+  free(f->file_defs);
+  free(f->names);
+  free(f->names_buf);
+  free(f->names_list);
+  f->bucket_first = NULL;
+  f->file_defs = NULL;
+  f->names = NULL;
+  f->names_buf = NULL;
+  f->names_list = NULL;
+  if (f->bdt_fd >= 0)
+    file_close(f->bdt_fd);
+  f->bdt_fd = -1;
+  free(f->file_buf);
+  f->file_buf = NULL;
 }
 
-void *bhd_get_file(struct BHD_FILE *f, uint32_t file_num, size_t *p_size, char **p_name)
+static int find_bhd5(struct BHD_FILE *f, const char *name, uint32_t *p_file_num)
+{
+  // BHD5 hashes are of the path without the drive ("/chr/c0000.chrbnd")
+  uint32_t hash = path_hash(name_skip_drive(name));
+  uint32_t bucket = hash % f->n_buckets;
+  for (uint32_t file_num = f->bucket_first[bucket]; file_num < f->bucket_first[bucket + 1]; file_num++) {
+    if (read_u32(f, f->file_defs[file_num]) == hash) {
+      *p_file_num = file_num;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Name the files of a BHD5 using a list of paths (one per line), since
+ * the BHD5 has only hashes of the names.  Returns the number of files
+ * named in 'p_n_found'.
+ */
+int bhd_load_names(struct BHD_FILE *f, const char *list_filename, uint32_t *p_n_found)
 {
-  uint32_t off = 0x20 + file_num * 0x18;
+  if (f->version != 5)
+    return 1;
 
+  size_t list_size;
+  char *list = read_file(list_filename, &list_size);
+  if (! list)
+    return 1;
+  char *terminated = realloc(list, list_size + 1);  // room for the last '\0'
+  if (! terminated) {
+    free(list);
+    return 1;
+  }
+  list = terminated;
+
+  // names from a previous list point into it: go back to the defaults
+  for (uint32_t file_num = 0; file_num < f->n_files; file_num++)
+    f->names[file_num] = f->names_buf + file_num * 16;
+  free(f->names_list);
+  f->names_list = list;
+
+  uint32_t n_found = 0;
+  char *line = list;
+  while (line < list + list_size) {
+    char *end = memchr(line, '\n', list + list_size - line);
+    if (! end)
+      end = list + list_size;
+    *end = '\0';
+    if (end > line && end[-1] == '\r')
+      end[-1] = '\0';
+
+    uint32_t file_num;
+    if (*line != '\0' && *line != '#' && find_bhd5(f, line, &file_num) == 0) {
+      f->names[file_num] = line;
+      n_found++;
+    }
+    line = end + 1;
+  }
+
+  if (p_n_found)
+    *p_n_found = n_found;
+  return 0;
+}
+
+static int get_entry(struct BHD_FILE *f, uint32_t file_num, uint64_t *p_off, uint64_t *p_size, char **p_name)
+{
+  if (file_num >= f->n_files)
+    return 1;
+
+  if (f->version == 5) {
+    uint32_t def = f->file_defs[file_num];
+    *p_size = read_u32(f, def + 4);
+    *p_off = read_u64(f, def + 8);
+    if (p_name)
+      *p_name = f->names[file_num];
+    return 0;
+  }
+
+  uint64_t off = 0x20 + (uint64_t) file_num * 0x18;
+  if (off + 0x18 > f->bhd_size)
+    return 1;
   *p_size = get_u32_le(f->bhd, off + 4);
-  size_t file_off = get_u32_le(f->bhd, off + 8);
-  if (p_name)
-    *p_name = (char *) f->bhd + get_u32_le(f->bhd, off + 16);
+  *p_off = get_u32_le(f->bhd, off + 8);
+  if (p_name) {
+    uint32_t name_off = get_u32_le(f->bhd, off + 16);
+    *p_name = (name_off < f->bhd_size) ? (char *) f->bhd + name_off : NULL;
+  }
+  return 0;
+}
+
+/*
+ * Get the size and name of a file without touching its data.
+ */
+int bhd_get_file_info(struct BHD_FILE *f, uint32_t file_num, size_t *p_size, char **p_name)
+{
+  uint64_t off, size;
+  if (get_entry(f, file_num, &off, &size, p_name) != 0)
+    return 1;
+  if (p_size)
+    *p_size = size;
+  return 0;
+}
+
+/*
+ * Get the position of a file in the BDT.  Returns nonzero if it's
+ * outside the BDT.
+ */
+int bhd_get_file_pos(struct BHD_FILE *f, uint32_t file_num, uint64_t *p_off)
+{
+  uint64_t off, size;
+  if (get_entry(f, file_num, &off, &size, NULL) != 0)
+    return 1;
+  if (off > f->bdt_size || size > f->bdt_size - off)
+    return 1;
+  *p_off = off;
+  return 0;
+}
 
-  return (char *) f->bdt + file_off;
+/*
+ * Read 'size' bytes starting at 'off' of a file into 'buf'.
+ */
+int bhd_read_file(struct BHD_FILE *f, uint32_t file_num, size_t off, void *buf, size_t size)
+{
+  uint64_t file_off, file_size;
+  if (get_entry(f, file_num, &file_off, &file_size, NULL) != 0)
+    return 1;
+  if (off > file_size || size > file_size - off)
+    return 1;
+  if (file_off > f->bdt_size || file_size > f->bdt_size - file_off)
+    return 1;
+  if (! f->bdt)
+    return file_pread(f->bdt_fd, buf, size, file_off + off);
+  memcpy(buf, (char *) f->bdt + file_off + off, size);
+  return 0;
+}
+
+/*
+ * Get a file's data, or NULL if it's outside the BDT.  BHD5 files are
+ * read into a buffer that's only valid until the next call.
+ */
+void *bhd_get_file(struct BHD_FILE *f, uint32_t file_num, size_t *p_size, char **p_name)
+{
+  uint64_t off, size;
+  if (get_entry(f, file_num, &off, &size, p_name) != 0)
+    return NULL;
+  *p_size = size;
+  if (off > f->bdt_size || size > f->bdt_size - off)
+    return NULL;
+
+  if (f->bdt)
+    return (char *) f->bdt + off;
+
+  if (size + 1 > f->file_buf_size) {
+    unsigned char *buf = realloc(f->file_buf, size + 1);
+    if (! buf)
+      return NULL;
+    f->file_buf = buf;
+    f->file_buf_size = size + 1;
+  }
+  if (file_pread(f->bdt_fd, f->file_buf, size, off) != 0)
+    return NULL;
+  return f->file_buf;
+}
+
+static const char *get_index_name(void *user, uint32_t file_num)
+{
+  uint64_t off, size;
+  char *name;
+  if (get_entry(user, file_num, &off, &size, &name) != 0)
+    return NULL;
+  return name;
+}
+
+/*
+ * Find a file by name (see name_index.h for how names are matched).
+ * BHD5 files are found with the name hash, which needs the full path
+ * (e.g. "/chr/c0000.chrbnd").  Returns 0 if found.
+ */
+int bhd_find(struct BHD_FILE *f, const char *name, uint32_t *p_file_num)
+{
+  if (f->version == 5)
+    return find_bhd5(f, name, p_file_num);
+  if (f->index.n_slots == 0 && name_index_build(&f->index, f->n_files, get_index_name, f) != 0)
+    return 1;
+  return name_index_find(&f->index, name, get_index_name, f, p_file_num);
+}
+
+/*
+ * Write a little endian BHF3/BDF3 pair with the given files.  The BDT
+ * is written in a single pass, with groups of files read and compressed
+ * in parallel, and the file data aligned to PACK_DATA_ALIGN; the BHD is
+ * written at the end.
+ */
+int bhd_write(const char *bhd_filename, struct PACK_FILE *files, uint32_t n_files, int level)
+{
+  static const unsigned char bdt_header[16] = "BDF307D7R6";
+  FILE *f = NULL;
+  bool created_bdt = false;
+  bool created_bhd = false;
+  unsigned char *toc = NULL;
+  uint32_t *offsets = malloc((n_files + 1) * sizeof(uint32_t));
+  char *bdt_filename = get_bdt_filename(bhd_filename);
+  if (! offsets || ! bdt_filename)
+    goto err;
+
+  f = fopen(bdt_filename, "wb");
+  if (! f) {
+    printf("* ERROR: can't create '%s'\n", bdt_filename);
+    goto err;
+  }
+  created_bdt = true;
+  uint64_t pos = 0;
+  if (pack_write(f, bdt_header, sizeof(bdt_header), &pos) != 0)
+    goto err_write_bdt;
+  for (uint32_t first = 0; first < n_files; first += PACK_WRITE_WINDOW) {
+    uint32_t n = (n_files - first < PACK_WRITE_WINDOW) ? n_files - first : PACK_WRITE_WINDOW;
+    if (pack_load_files(files + first, n, level) != 0)
+      goto err;
+    for (uint32_t i = first; i < first + n; i++) {
+      if (pack_write_padding(f, PACK_DATA_ALIGN, &pos) != 0)
+        goto err_write_bdt;
+      if (pos + files[i].out_size > UINT32_MAX) {
+        printf("* ERROR: BDT too big (more than 4 GB)\n");
+        goto err;
+      }
+      offsets[i] = pos;
+      if (pack_write(f, files[i].out_data, files[i].out_size, &pos) != 0)
+        goto err_write_bdt;
+    }
+    pack_release_files(files + first, n);
+  }
+  int close_ret = fclose(f);
+  f = NULL;
+  if (close_ret != 0)
+    goto err_write_bdt;
+
+  size_t toc_size = pack_toc_size(files, n_files);
+  toc = calloc(1, toc_size);
+  if (! toc)
+    goto err;
+  pack_fill_toc(toc, "BHF3", files, n_files, offsets);
+  f = fopen(bhd_filename, "wb");
+  if (! f) {
+    printf("* ERROR: can't create '%s'\n", bhd_filename);
+    goto err;
+  }
+  created_bhd = true;
+  pos = 0;
+  int write_ret = pack_write(f, toc, toc_size, &pos);
+  close_ret = fclose(f);
+  f = NULL;
+  if (write_ret != 0 || close_ret != 0) {
+    printf("* ERROR: can't write '%s'\n", bhd_filename);
+    goto err;
+  }
+
+  free(toc);
+  free(offsets);
+  free(bdt_filename);
+  return 0;
+
+ err_write_bdt:
+  printf("* ERROR: can't write '%s'\n", bdt_filename);
+ err:
+  if (f)
+    fclose(f);
+  if (created_bdt)
+    remove(bdt_filename);
+  if (created_bhd)
+    remove(bhd_filename);
+  pack_release_files(files, n_files);
+  free(toc);
+  free(offsets);
+  free(bdt_filename);
+  return 1;
 }
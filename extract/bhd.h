@@ -5,18 +5,44 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "name_index.h"
+#include "pack.h"
 
 struct BHD_FILE {
   void *bhd;
   size_t bhd_size;
-  void *bdt;
+  void *bdt;                // NULL for BHD5 (read with pread from bdt_fd)
   size_t bdt_size;
+  bool owns_data;
 
+  int version;              // 3 (BHF3/BDF3) or 5 (BHD5)
   uint32_t n_files;
+  struct NAME_INDEX index;  // built on the first bhd_find() (BHD3)
+
+  // BHD5 only
+  bool big_endian;
+  uint32_t n_buckets;
+  uint32_t *bucket_first;   // number of the first file of each bucket
+  uint32_t *file_defs;      // offset of each file definition in bhd
+  char **names;             // names from bhd_load_names(), or "<hash>.dat"
+  char *names_buf;
+  char *names_list;
+  int bdt_fd;
+  unsigned char *file_buf;
+  size_t file_buf_size;
 };
 
 int bhd_open(struct BHD_FILE *f, const char *bhd_filename);
+int bhd_open_mem(struct BHD_FILE *f, const void *bhd, size_t bhd_size, const void *bdt, size_t bdt_size);
 void bhd_close(struct BHD_FILE *f);
+int bhd_load_names(struct BHD_FILE *f, const char *list_filename, uint32_t *p_n_found);
+int bhd_get_file_info(struct BHD_FILE *f, uint32_t file_num, size_t *p_size, char **p_name);
+int bhd_get_file_pos(struct BHD_FILE *f, uint32_t file_num, uint64_t *p_off);
+int bhd_read_file(struct BHD_FILE *f, uint32_t file_num, size_t off, void *buf, size_t size);
 void *bhd_get_file(struct BHD_FILE *f, uint32_t file_num, size_t *p_size, char **p_name);
+int bhd_find(struct BHD_FILE *f, const char *name, uint32_t *p_file_num);
+int bhd_write(const char *bhd_filename, struct PACK_FILE *files, uint32_t n_files, int level);
 
 #endif /* BHD_H_FILE */
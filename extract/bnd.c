@@ -9,25 +9,294 @@
 #include "dcx.h"
 #include "reader.h"
 
-static uint32_t read_u32(struct BND_FILE *bnd, size_t offset)
+// BND4 format flags
+#define BND4_FORMAT_IDS           0x02
+#define BND4_FORMAT_NAMES1        0x04
+#define BND4_FORMAT_NAMES2        0x08
+#define BND4_FORMAT_LONG_OFFSETS  0x10
+#define BND4_FORMAT_COMPRESSION   0x20
+
+#define BND4_HEADER_SIZE  0x40
+#define BND4_EXT_HASH_TABLE  4
+
+static uint32_t read_u32(struct BND_FILE *bnd, uint64_t offset)
 {
-  if (offset + 4 > bnd->size)
+  if (offset > bnd->size || bnd->size - offset < 4)
     return 0;
-  
+
   if (bnd->big_endian)
     return get_u32_be(bnd->data, offset);
   else
     return get_u32_le(bnd->data, offset);
 }
 
+static uint64_t read_u64(struct BND_FILE *bnd, uint64_t offset)
+{
+  uint64_t lo = read_u32(bnd, offset + (bnd->big_endian ? 4 : 0));
+  uint64_t hi = read_u32(bnd, offset + (bnd->big_endian ? 0 : 4));
+  return hi << 32 | lo;
+}
+
+/*
+ * File definition readers for each BND3 byte order and stride:
+ *   0x0c: flags, size, offset
+ *   0x14: flags, size, offset, id, name offset
+ *   0x18: flags, size, offset, id, name offset, uncompressed size
+ */
+#define BND3_READERS(X) \
+  X(le, 0x14)           \
+  X(le, 0x18)           \
+  X(be, 0x0c)           \
+  X(be, 0x14)           \
+  X(be, 0x18)
+
+#define DEFINE_BND3_READER(endian, stride)                              \
+  static void read_entry_bnd3_##endian##_##stride(const struct BND_FILE *bnd, uint32_t file_num, struct BND_ENTRY *entry) \
+  {                                                                     \
+    const unsigned char *def = bnd->data + 0x20 + (size_t) file_num * stride; \
+    entry->size = get_u32_##endian(def, 4);                             \
+    entry->off = get_u32_##endian(def, 8);                              \
+    entry->name_off = (stride >= 0x14) ? get_u32_##endian(def, 0x10) : 0; \
+  }
+
+BND3_READERS(DEFINE_BND3_READER)
+
+/*
+ * File definition readers for each BND4 byte order and offset size.
+ * The stride and field positions depend on the format flags.
+ */
+#define BND4_READERS(X) \
+  X(le, u32)            \
+  X(le, u64)            \
+  X(be, u32)            \
+  X(be, u64)
+
+#define DEFINE_BND4_READER(endian, off_type)                            \
+  static void read_entry_bnd4_##endian##_##off_type(const struct BND_FILE *bnd, uint32_t file_num, struct BND_ENTRY *entry) \
+  {                                                                     \
+    const unsigned char *def = bnd->data + 0x40 + (size_t) file_num * bnd->file_def_stride; \
+    entry->size = get_u64_##endian(def, 8);                             \
+    entry->off = get_##off_type##_##endian(def, bnd->off_pos);          \
+    entry->name_off = (bnd->file_id_sequential) ? 0 : get_u32_##endian(def, bnd->name_pos); \
+  }
+
+BND4_READERS(DEFINE_BND4_READER)
+
+static void init_bnd(struct BND_FILE *bnd)
+{
+  bnd->data = NULL;
+  bnd->size = 0;
+  bnd->owns_data = false;
+  bnd->names = NULL;
+  bnd->hash_table_off = 0;
+  bnd->fd = -1;
+  bnd->file_size = 0;
+  bnd->file_buf = NULL;
+  bnd->file_buf_size = 0;
+  name_index_init(&bnd->index);
+}
+
+static bool is_bnd(const void *data, size_t size)
+{
+  return size >= 4 && (memcmp(data, "BND3", 4) == 0 || memcmp(data, "BND4", 4) == 0);
+}
+
+static int read_header_bnd3(struct BND_FILE *bnd)
+{
+  if (bnd->size < 0x20)
+    return 1;
+
+  bnd->big_endian = true;
+  bnd->file_id_sequential = false;
+  uint32_t flags = read_u32(bnd, 12);
+  if (flags == 0x74000000 || flags == 0x54000000 || flags == 0x70000000)
+    bnd->big_endian = false;
+
+  switch (flags) {
+  case 0x70000000: bnd->file_def_stride = 0x14; bnd->read_entry = read_entry_bnd3_le_0x14; break;
+  case 0x74000000: bnd->file_def_stride = 0x18; bnd->read_entry = read_entry_bnd3_le_0x18; break;
+  case 0x00010100: bnd->file_def_stride = 0x0c; bnd->read_entry = read_entry_bnd3_be_0x0c; bnd->file_id_sequential = true; break;
+  case 0x0E010100: bnd->file_def_stride = 0x14; bnd->read_entry = read_entry_bnd3_be_0x14; break;
+  case 0x2E010100: bnd->file_def_stride = 0x18; bnd->read_entry = read_entry_bnd3_be_0x18; break;
+  default:
+    return 1;
+  }
+
+  bnd->version = 3;
+  bnd->n_files = read_u32(bnd, 16);
+  bnd->file_defs_start = 0x20;
+  bnd->off_pos = 8;
+  bnd->name_pos = 0x10;
+  bnd->long_offsets = false;
+  return 0;
+}
+
+static uint8_t reverse_bits(uint8_t b)
+{
+  uint8_t r = 0;
+  for (int i = 0; i < 8; i++)
+    r |= ((b >> i) & 1) << (7 - i);
+  return r;
+}
+
+static int read_header_bnd4(struct BND_FILE *bnd)
+{
+  if (bnd->size < BND4_HEADER_SIZE)
+    return 1;
+
+  bnd->big_endian = (bnd->data[9] != 0);
+  bool bit_big_endian = (bnd->data[10] == 0);
+
+  // the format byte may be stored with its bits reversed
+  uint8_t format = bnd->data[0x31];
+  if (! (bit_big_endian || ((format & 1) != 0 && (format & 0x80) == 0)))
+    format = reverse_bits(format);
+
+  bnd->version = 4;
+  bnd->n_files = read_u32(bnd, 0x0c);
+  uint64_t stride = read_u64(bnd, 0x20);
+  if (stride < 0x10 || stride > 0x100)
+    return 1;
+  bnd->file_def_stride = stride;
+  bnd->file_defs_start = BND4_HEADER_SIZE;
+  bnd->file_id_sequential = ((format & (BND4_FORMAT_NAMES1 | BND4_FORMAT_NAMES2)) == 0);
+  bnd->long_offsets = ((format & BND4_FORMAT_LONG_OFFSETS) != 0);
+  bnd->off_pos = 0x10 + ((format & BND4_FORMAT_COMPRESSION) ? 8 : 0);
+  bnd->name_pos = bnd->off_pos + (bnd->long_offsets ? 8 : 4) + ((format & BND4_FORMAT_IDS) ? 4 : 0);
+  if (bnd->name_pos + (bnd->file_id_sequential ? 0 : 4) > stride)
+    return 1;
+  if (bnd->big_endian)
+    bnd->read_entry = (bnd->long_offsets) ? read_entry_bnd4_be_u64 : read_entry_bnd4_be_u32;
+  else
+    bnd->read_entry = (bnd->long_offsets) ? read_entry_bnd4_le_u64 : read_entry_bnd4_le_u32;
+
+  if (bnd->data[0x32] == BND4_EXT_HASH_TABLE)
+    bnd->hash_table_off = read_u64(bnd, 0x38);
+  return 0;
+}
+
+static int read_header(struct BND_FILE *bnd)
+{
+  if (bnd->size >= 4 && memcmp(bnd->data, "BND3", 4) == 0)
+    return read_header_bnd3(bnd);
+  if (bnd->size >= 4 && memcmp(bnd->data, "BND4", 4) == 0)
+    return read_header_bnd4(bnd);
+  return 1;
+}
+
+/*
+ * Return the offset where the TOC (header, file definitions, names and
+ * hash table) ends and file data starts.
+ */
+static uint64_t get_toc_size(struct BND_FILE *bnd)
+{
+  if (bnd->version == 4)
+    return read_u64(bnd, 0x28);
+  return read_u32(bnd, 0x14);
+}
+
+static uint32_t get_name_off(struct BND_FILE *bnd, uint32_t file_num)
+{
+  struct BND_ENTRY entry;
+  bnd->read_entry(bnd, file_num, &entry);
+  return entry.name_off;
+}
+
+static size_t get_utf16_len(struct BND_FILE *bnd, uint32_t off)
+{
+  size_t len = 0;
+  while ((size_t) off + 2*len + 2 <= bnd->size) {
+    uint16_t c = (bnd->big_endian) ? get_u16_be(bnd->data, off + 2*len) : get_u16_le(bnd->data, off + 2*len);
+    if (c == 0)
+      break;
+    len++;
+  }
+  return len;
+}
+
+static char *utf16_to_utf8(struct BND_FILE *bnd, uint32_t off, size_t len, char *out)
+{
+  for (size_t i = 0; i < len; i++) {
+    uint32_t c = (bnd->big_endian) ? get_u16_be(bnd->data, off + 2*i) : get_u16_le(bnd->data, off + 2*i);
+    if (c >= 0xd800 && c < 0xdc00 && i + 1 < len) {
+      uint32_t c2 = (bnd->big_endian) ? get_u16_be(bnd->data, off + 2*i + 2) : get_u16_le(bnd->data, off + 2*i + 2);
+      if (c2 >= 0xdc00 && c2 < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+        i++;
+      }
+    }
+    if (c < 0x80) {
+      *out++ = c;
+    } else if (c < 0x800) {
+      *out++ = 0xc0 | (c >> 6);
+      *out++ = 0x80 | (c & 0x3f);
+    } else if (c < 0x10000) {
+      *out++ = 0xe0 | (c >> 12);
+      *out++ = 0x80 | ((c >> 6) & 0x3f);
+      *out++ = 0x80 | (c & 0x3f);
+    } else {
+      *out++ = 0xf0 | (c >> 18);
+      *out++ = 0x80 | ((c >> 12) & 0x3f);
+      *out++ = 0x80 | ((c >> 6) & 0x3f);
+      *out++ = 0x80 | (c & 0x3f);
+    }
+  }
+  *out++ = '\0';
+  return out;
+}
+
+/*
+ * Convert the UTF-16 names of a BND4 to UTF-8.
+ */
+static int read_wide_names(struct BND_FILE *bnd)
+{
+  size_t names_size = 0;
+  for (uint32_t file_num = 0; file_num < bnd->n_files; file_num++) {
+    uint32_t name_off = get_name_off(bnd, file_num);
+    if (name_off < bnd->size)
+      names_size += 3 * get_utf16_len(bnd, name_off) + 1;
+  }
+
+  bnd->names = malloc(bnd->n_files * sizeof(char *) + names_size);
+  if (! bnd->names)
+    return 1;
+
+  char *p = (char *) (bnd->names + bnd->n_files);
+  for (uint32_t file_num = 0; file_num < bnd->n_files; file_num++) {
+    uint32_t name_off = get_name_off(bnd, file_num);
+    if (name_off >= bnd->size) {
+      bnd->names[file_num] = NULL;
+      continue;
+    }
+    bnd->names[file_num] = p;
+    p = utf16_to_utf8(bnd, name_off, get_utf16_len(bnd, name_off), p);
+  }
+  return 0;
+}
+
+/*
+ * Check the file definitions and read the names.  'data' must contain at
+ * least the whole TOC.
+ */
+static int read_toc(struct BND_FILE *bnd)
+{
+  if (bnd->file_defs_start + (uint64_t) bnd->n_files * bnd->file_def_stride > bnd->size)
+    return 1;
+
+  if (bnd->version == 4 && ! bnd->file_id_sequential && bnd->data[0x30] != 0)
+    return read_wide_names(bnd);
+  return 0;
+}
+
 int bnd_open(struct BND_FILE *bnd, const char *filename)
 {
   char magic[4];
-  
+
+  init_bnd(bnd);
   if (read_file_data(filename, 0, magic, 4) != 0)
     return 1;
 
-  if (memcmp(magic, "BND3", 4) == 0) {
+  if (is_bnd(magic, 4)) {
     bnd->data = read_file(filename, &bnd->size);
   } else if (memcmp(magic, "DCX", 4) == 0) {
     bnd->data = dcx_read_file(filename, &bnd->size);
@@ -36,49 +305,339 @@ int bnd_open(struct BND_FILE *bnd, const char *filename)
   }
   if (! bnd->data)
     return 1;
+  bnd->owns_data = true;
 
-  bnd->big_endian = true;
-  bnd->file_id_sequential = false;
-  uint32_t flags = read_u32(bnd, 12);
-  if (flags == 0x74000000 || flags == 0x54000000 || flags == 0x70000000)
-    bnd->big_endian = false;
+  if (read_header(bnd) != 0 || read_toc(bnd) != 0) {
+    bnd_close(bnd);
+    return 1;
+  }
+  return 0;
+}
 
-  switch (flags) {
-  case 0x70000000: bnd->file_def_stride = 0x14; break;
-  case 0x74000000: bnd->file_def_stride = 0x18; break;
-  case 0x00010100: bnd->file_def_stride = 0x0c; bnd->file_id_sequential = true; break;
-  case 0x0E010100: bnd->file_def_stride = 0x14; break;
-  case 0x2E010100: bnd->file_def_stride = 0x18; break;
-  default:
-    goto err;
+/*
+ * Open a BND from memory.  Plain BND data is used in place and must
+ * stay valid until bnd_close(), DCX data is inflated.
+ */
+int bnd_open_mem(struct BND_FILE *bnd, const void *data, size_t size)
+{
+  init_bnd(bnd);
+  if (is_bnd(data, size)) {
+    bnd->data = (unsigned char *) data;
+    bnd->size = size;
+    bnd->owns_data = false;
+  } else if (size >= 4 && memcmp(data, "DCX", 4) == 0) {
+    bnd->data = dcx_read_mem(data, size, &bnd->size);
+    if (! bnd->data)
+      return 1;
+    bnd->owns_data = true;
+  } else {
+    return 1;
+  }
+
+  if (read_header(bnd) != 0 || read_toc(bnd) != 0) {
+    bnd_close(bnd);
+    return 1;
   }
-  
-  bnd->n_files = read_u32(bnd, 16);
   return 0;
+}
 
- err:
-  free(bnd->data);
-  return 1;
+/*
+ * Open a BND reading only its header and table of contents.  Files are
+ * read when requested with bnd_get_file().  Compressed (DCX) files can't
+ * be read partially, so they're opened with bnd_open().
+ */
+int bnd_open_lazy(struct BND_FILE *bnd, const char *filename)
+{
+  unsigned char header[BND4_HEADER_SIZE];
+
+  init_bnd(bnd);
+  size_t file_size;
+  if (get_file_size(filename, &file_size) != 0)
+    return 1;
+  int fd = file_open_read(filename);
+  if (fd < 0)
+    return 1;
+  size_t header_size = (file_size < sizeof(header)) ? file_size : sizeof(header);
+  if (file_pread(fd, header, header_size, 0) != 0 || ! is_bnd(header, header_size)) {
+    file_close(fd);
+    return bnd_open(bnd, filename);
+  }
+
+  // find where the TOC (file definitions and names) ends
+  bnd->data = header;
+  bnd->size = header_size;
+  if (read_header(bnd) != 0) {
+    file_close(fd);
+    init_bnd(bnd);
+    return 1;
+  }
+  uint64_t toc_size = get_toc_size(bnd);
+  if (toc_size < bnd->file_defs_start + (uint64_t) bnd->n_files * bnd->file_def_stride || toc_size > file_size) {
+    // no usable TOC size, read everything
+    file_close(fd);
+    return bnd_open(bnd, filename);
+  }
+
+  bnd->data = malloc(toc_size);
+  if (! bnd->data || file_pread(fd, bnd->data, toc_size, 0) != 0) {
+    free(bnd->data);
+    file_close(fd);
+    init_bnd(bnd);
+    return 1;
+  }
+  bnd->size = toc_size;
+  bnd->owns_data = true;
+  bnd->fd = fd;
+  bnd->file_size = file_size;
+  if (read_toc(bnd) != 0) {
+    bnd_close(bnd);
+    return 1;
+  }
+  return 0;
 }
 
 void bnd_close(struct BND_FILE *f)
 {
-  free(f->data);
+  if (f->owns_data)
+    free(f->data);
   f->data = NULL;
+  free(f->names);
+  f->names = NULL;
+  if (f->fd >= 0)
+    file_close(f->fd);
+  f->fd = -1;
+  free(f->file_buf);
+  f->file_buf = NULL;
+  name_index_free(&f->index);
 }
 
-void *bnd_get_file(struct BND_FILE *bnd, unsigned int file_num, size_t *p_size, char **p_name)
+static int get_entry(struct BND_FILE *bnd, uint32_t file_num, uint64_t *p_off, uint64_t *p_size, char **p_name)
 {
   if (file_num >= bnd->n_files)
-    return NULL;
+    return 1;
 
-  uint32_t file_size = read_u32(bnd, 0x24 + file_num*bnd->file_def_stride);
-  uint32_t file_off = read_u32(bnd, 0x28 + file_num*bnd->file_def_stride);
-  uint32_t name_off = read_u32(bnd, 0x30 + file_num*bnd->file_def_stride);
+  struct BND_ENTRY entry;
+  bnd->read_entry(bnd, file_num, &entry);
+  if (p_size)
+    *p_size = entry.size;
+  if (p_off)
+    *p_off = entry.off;
+  if (p_name) {
+    if (bnd->file_id_sequential)
+      *p_name = NULL;
+    else if (bnd->names)
+      *p_name = bnd->names[file_num];
+    else
+      *p_name = (entry.name_off < bnd->size) ? (char *) bnd->data + entry.name_off : NULL;
+  }
+  return 0;
+}
 
+/*
+ * Get the size and name of a file without touching its data.
+ */
+int bnd_get_file_info(struct BND_FILE *bnd, unsigned int file_num, size_t *p_size, char **p_name)
+{
+  uint64_t file_size;
+  if (get_entry(bnd, file_num, NULL, &file_size, p_name) != 0 || file_size > SIZE_MAX)
+    return 1;
   if (p_size)
     *p_size = file_size;
-  if (p_name)
-    *p_name = (bnd->file_id_sequential) ? NULL : (char *) bnd->data + name_off;
-  return bnd->data + file_off;
+  return 0;
+}
+
+/*
+ * Get the position of a file's data in the BND file.  Returns nonzero if
+ * it's outside the file.
+ */
+int bnd_get_file_pos(struct BND_FILE *bnd, unsigned int file_num, uint64_t *p_off)
+{
+  uint64_t file_off, file_size;
+  if (get_entry(bnd, file_num, &file_off, &file_size, NULL) != 0)
+    return 1;
+  uint64_t total_size = (bnd->fd >= 0) ? bnd->file_size : bnd->size;
+  if (file_off > total_size || file_size > total_size - file_off)
+    return 1;
+  *p_off = file_off;
+  return 0;
+}
+
+/*
+ * Read 'size' bytes starting at 'off' of a file into 'buf'.
+ */
+int bnd_read_file(struct BND_FILE *bnd, unsigned int file_num, size_t off, void *buf, size_t size)
+{
+  uint64_t file_off, file_size;
+  if (get_entry(bnd, file_num, &file_off, &file_size, NULL) != 0)
+    return 1;
+  if (off > file_size || size > file_size - off)
+    return 1;
+
+  uint64_t total_size = (bnd->fd >= 0) ? bnd->file_size : bnd->size;
+  if (file_off > total_size || file_size > total_size - file_off)
+    return 1;
+  if (bnd->fd >= 0)
+    return file_pread(bnd->fd, buf, size, file_off + off);
+  memcpy(buf, bnd->data + file_off + off, size);
+  return 0;
+}
+
+/*
+ * Get a file's data.  In lazy mode the data is read into a buffer that's
+ * only valid until the next call.  Returns NULL if the data is outside
+ * the file or can't be read.
+ */
+void *bnd_get_file(struct BND_FILE *bnd, unsigned int file_num, size_t *p_size, char **p_name)
+{
+  uint64_t file_off, file_size;
+  if (get_entry(bnd, file_num, &file_off, &file_size, p_name) != 0 || file_size >= SIZE_MAX)
+    return NULL;
+  if (p_size)
+    *p_size = file_size;
+
+  if (bnd->fd < 0) {
+    if (file_off > bnd->size || file_size > bnd->size - file_off)
+      return NULL;
+    return bnd->data + file_off;
+  }
+
+  if (file_size + 1 > bnd->file_buf_size) {
+    unsigned char *buf = realloc(bnd->file_buf, file_size + 1);
+    if (! buf)
+      return NULL;
+    bnd->file_buf = buf;
+    bnd->file_buf_size = file_size + 1;
+  }
+  if (bnd_read_file(bnd, file_num, 0, bnd->file_buf, file_size) != 0)
+    return NULL;
+  return bnd->file_buf;
+}
+
+static const char *get_index_name(void *user, uint32_t file_num)
+{
+  char *name;
+  if (get_entry(user, file_num, NULL, NULL, &name) != 0)
+    return NULL;
+  return name;
+}
+
+/*
+ * Look up a name in the BND4 hash table.  The table has 'n_groups'
+ * {length, first} groups selecting runs of {hash, file_num} entries.
+ */
+static int find_hashed(struct BND_FILE *bnd, const char *name, uint32_t *p_file_num)
+{
+  uint64_t table = bnd->hash_table_off;
+  if (table > bnd->size || bnd->size - table < 0x10)
+    return 1;
+  uint64_t hashes_off = read_u64(bnd, table);
+  uint32_t n_groups = read_u32(bnd, table + 8);
+  if (n_groups == 0 || table + 0x10 + 8 * (uint64_t) n_groups > bnd->size
+      || hashes_off > bnd->size || 8 * (uint64_t) bnd->n_files > bnd->size - hashes_off)
+    return 1;
+
+  uint32_t hash = path_hash(name);
+  uint64_t group = table + 0x10 + 8 * (uint64_t) (hash % n_groups);
+  uint32_t len = read_u32(bnd, group);
+  uint32_t first = read_u32(bnd, group + 4);
+  if (first > bnd->n_files || len > bnd->n_files - first)
+    return 1;
+
+  for (uint32_t i = first; i < first + len; i++) {
+    if (read_u32(bnd, hashes_off + 8 * (uint64_t) i) != hash)
+      continue;
+    uint32_t file_num = read_u32(bnd, hashes_off + 8 * (uint64_t) i + 4);
+    const char *file_name = get_index_name(bnd, file_num);
+    if (file_name && name_equal(name, file_name)) {
+      *p_file_num = file_num;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+ * Find a file by name (see name_index.h for how names are matched).
+ * BND4 hash tables are used when present; since they hash the exact
+ * path, names not found there are looked up in our own index.  Returns 0
+ * if found.
+ */
+int bnd_find(struct BND_FILE *bnd, const char *name, uint32_t *p_file_num)
+{
+  if (bnd->file_id_sequential)
+    return 1;
+  if (bnd->hash_table_off != 0 && find_hashed(bnd, name, p_file_num) == 0)
+    return 0;
+  if (bnd->index.n_slots == 0 && name_index_build(&bnd->index, bnd->n_files, get_index_name, bnd) != 0)
+    return 1;
+  return name_index_find(&bnd->index, name, get_index_name, bnd, p_file_num);
+}
+
+/*
+ * Write a little endian BND3 with the given files.  The file data is
+ * written in a single pass after space for the header and file table,
+ * with groups of files read and compressed in parallel and aligned to
+ * PACK_DATA_ALIGN; the file table is filled in at the end, when the
+ * compressed sizes are known.
+ */
+int bnd_write(const char *filename, struct PACK_FILE *files, uint32_t n_files, int level)
+{
+  FILE *f = NULL;
+  bool created = false;
+  uint32_t *offsets = malloc((n_files + 1) * sizeof(uint32_t));
+  size_t toc_size = pack_toc_size(files, n_files);
+  unsigned char *toc = calloc(1, toc_size);
+  if (! offsets || ! toc)
+    goto err;
+
+  f = fopen(filename, "wb");
+  if (! f) {
+    printf("* ERROR: can't create '%s'\n", filename);
+    goto err;
+  }
+  created = true;
+  uint64_t pos = 0;
+  if (pack_write(f, toc, toc_size, &pos) != 0)
+    goto err_write;
+  for (uint32_t first = 0; first < n_files; first += PACK_WRITE_WINDOW) {
+    uint32_t n = (n_files - first < PACK_WRITE_WINDOW) ? n_files - first : PACK_WRITE_WINDOW;
+    if (pack_load_files(files + first, n, level) != 0)
+      goto err;
+    for (uint32_t i = first; i < first + n; i++) {
+      if (pack_write_padding(f, PACK_DATA_ALIGN, &pos) != 0)
+        goto err_write;
+      if (pos + files[i].out_size > UINT32_MAX) {
+        printf("* ERROR: BND3 too big (more than 4 GB)\n");
+        goto err;
+      }
+      offsets[i] = pos;
+      if (pack_write(f, files[i].out_data, files[i].out_size, &pos) != 0)
+        goto err_write;
+    }
+    pack_release_files(files + first, n);
+  }
+
+  pack_fill_toc(toc, "BND3", files, n_files, offsets);
+  if (fseek(f, 0, SEEK_SET) != 0 || fwrite(toc, 1, toc_size, f) != toc_size)
+    goto err_write;
+  int close_ret = fclose(f);
+  f = NULL;
+  if (close_ret != 0)
+    goto err_write;
+
+  free(toc);
+  free(offsets);
+  return 0;
+
+ err_write:
+  printf("* ERROR: can't write '%s'\n", filename);
+ err:
+  if (f)
+    fclose(f);
+  if (created)
+    remove(filename);
+  pack_release_files(files, n_files);
+  free(toc);
+  free(offsets);
+  return 1;
 }
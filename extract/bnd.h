@@ -7,17 +7,63 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "name_index.h"
+#include "pack.h"
+
+struct BND_FILE;
+
+struct BND_ENTRY {
+  uint64_t off;
+  uint64_t size;
+  uint32_t name_off;
+};
+
+/*
+ * Decode a file definition.  There's one of these for each byte order
+ * and layout, selected at open; they don't check bounds, so the whole
+ * table of file definitions must be checked to be inside 'data' first.
+ */
+typedef void (*bnd_entry_func)(const struct BND_FILE *bnd, uint32_t file_num, struct BND_ENTRY *entry);
+
 struct BND_FILE {
   unsigned char *data;
   size_t size;
+  bool owns_data;
   bool big_endian;
-  bool file_id_sequential;
+  bool file_id_sequential;  // files have no names
   uint32_t n_files;
   uint32_t file_def_stride;
+
+  // file definition layout
+  int version;              // 3 (BND3) or 4 (BND4)
+  uint32_t file_defs_start;
+  uint32_t off_pos;         // BND4 field positions inside each file definition
+  uint32_t name_pos;
+  bool long_offsets;
+  bnd_entry_func read_entry;
+
+  // BND4 only
+  char **names;             // UTF-8 names converted from UTF-16, or NULL
+  uint64_t hash_table_off;  // 0 if there's no hash table
+
+  // lazy mode: 'data' has only the header and TOC, files are read on demand
+  int fd;                   // -1 if not in lazy mode
+  size_t file_size;
+  unsigned char *file_buf;
+  size_t file_buf_size;
+
+  struct NAME_INDEX index;  // built on the first bnd_find() that needs it
 };
 
 int bnd_open(struct BND_FILE *bnd, const char *filename);
+int bnd_open_mem(struct BND_FILE *bnd, const void *data, size_t size);
+int bnd_open_lazy(struct BND_FILE *bnd, const char *filename);
 void bnd_close(struct BND_FILE *bnd);
+int bnd_get_file_info(struct BND_FILE *bnd, unsigned int file_num, size_t *p_size, char **p_name);
+int bnd_get_file_pos(struct BND_FILE *bnd, unsigned int file_num, uint64_t *p_off);
+int bnd_read_file(struct BND_FILE *bnd, unsigned int file_num, size_t off, void *buf, size_t size);
 void *bnd_get_file(struct BND_FILE *bnd, unsigned int file_num, size_t *p_size, char **p_name);
+int bnd_find(struct BND_FILE *bnd, const char *name, uint32_t *p_file_num);
+int bnd_write(const char *filename, struct PACK_FILE *files, uint32_t n_files, int level);
 
 #endif /* BND_H_FILE */
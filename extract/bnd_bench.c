@@ -0,0 +1,164 @@
+/* bnd_bench.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "bnd.h"
+#include "util.h"
+
+#define BENCH_FILES       100000
+#define BENCH_ITERATIONS  20
+#define BENCH_NAME_LEN    32
+
+static void put_u32(unsigned char *p, uint32_t v, int big_endian)
+{
+  for (int i = 0; i < 4; i++)
+    p[i] = v >> (big_endian ? 24 - 8*i : 8*i);
+}
+
+static void put_u64(unsigned char *p, uint64_t v, int big_endian)
+{
+  put_u32(p + (big_endian ? 4 : 0), (uint32_t) v, big_endian);
+  put_u32(p + (big_endian ? 0 : 4), (uint32_t) (v >> 32), big_endian);
+}
+
+static void make_name(char *name, uint32_t file_num)
+{
+  snprintf(name, BENCH_NAME_LEN, "N:\\bench\\d%03u\\f%06u.bin", (unsigned) (file_num % 1000), (unsigned) file_num);
+}
+
+/*
+ * Build a BND3 with 'n_files' empty files.  'flags' selects the byte
+ * order and stride (0x74000000 or 0x2E010100).
+ */
+static unsigned char *make_bnd3(uint32_t n_files, uint32_t flags, size_t *p_size)
+{
+  int big_endian = (flags == 0x2E010100);
+  size_t names_start = 0x20 + (size_t) n_files * 0x18;
+  size_t size = names_start + (size_t) n_files * BENCH_NAME_LEN;
+  unsigned char *bnd = calloc(1, size);
+  if (! bnd)
+    return NULL;
+
+  memcpy(bnd, "BND307D7R6", 10);
+  put_u32(bnd + 12, flags, 1);
+  put_u32(bnd + 16, n_files, big_endian);
+  put_u32(bnd + 20, size, big_endian);
+  for (uint32_t i = 0; i < n_files; i++) {
+    unsigned char *def = bnd + 0x20 + (size_t) i * 0x18;
+    size_t name_off = names_start + (size_t) i * BENCH_NAME_LEN;
+    put_u32(def + 0x00, 0x40, big_endian);
+    put_u32(def + 0x04, i & 0xff, big_endian);
+    put_u32(def + 0x08, size, big_endian);
+    put_u32(def + 0x0c, i, big_endian);
+    put_u32(def + 0x10, name_off, big_endian);
+    put_u32(def + 0x14, i & 0xff, big_endian);
+    make_name((char *) bnd + name_off, i);
+  }
+  *p_size = size;
+  return bnd;
+}
+
+/*
+ * Build a little endian BND4 with 'n_files' empty files, with UTF-16
+ * names and 32-bit offsets.
+ */
+static unsigned char *make_bnd4(uint32_t n_files, size_t *p_size)
+{
+  size_t stride = 0x24;
+  size_t names_start = 0x40 + (size_t) n_files * stride;
+  size_t size = names_start + (size_t) n_files * 2 * BENCH_NAME_LEN;
+  unsigned char *bnd = calloc(1, size);
+  if (! bnd)
+    return NULL;
+
+  memcpy(bnd, "BND4", 4);
+  bnd[0x0a] = 1;
+  put_u32(bnd + 0x0c, n_files, 0);
+  put_u64(bnd + 0x10, 0x40, 0);
+  memcpy(bnd + 0x18, "07D7R600", 8);
+  put_u64(bnd + 0x20, stride, 0);
+  put_u64(bnd + 0x28, size, 0);
+  bnd[0x30] = 1;     // unicode names
+  bnd[0x31] = 0x74;  // ids, names, compression (bits reversed)
+  for (uint32_t i = 0; i < n_files; i++) {
+    unsigned char *def = bnd + 0x40 + (size_t) i * stride;
+    size_t name_off = names_start + (size_t) i * 2 * BENCH_NAME_LEN;
+    char name[BENCH_NAME_LEN];
+    def[0] = 0x40;
+    put_u32(def + 0x04, 0xffffffff, 0);
+    put_u64(def + 0x08, i & 0xff, 0);
+    put_u64(def + 0x10, i & 0xff, 0);
+    put_u32(def + 0x18, size, 0);
+    put_u32(def + 0x1c, i, 0);
+    put_u32(def + 0x20, name_off, 0);
+    make_name(name, i);
+    for (size_t c = 0; name[c] != '\0'; c++)
+      bnd[name_off + 2*c] = name[c];
+  }
+  *p_size = size;
+  return bnd;
+}
+
+static int bench_bnd(const char *label, unsigned char *data, size_t size)
+{
+  struct BND_FILE bnd;
+  if (! data || bnd_open_mem(&bnd, data, size) != 0) {
+    printf("* ERROR: can't open %s\n", label);
+    free(data);
+    return 1;
+  }
+
+  // walk the TOC
+  uint64_t check = 0;
+  double start = get_time();
+  for (int iter = 0; iter < BENCH_ITERATIONS; iter++) {
+    for (uint32_t i = 0; i < bnd.n_files; i++) {
+      size_t file_size;
+      char *name;
+      bnd_get_file_info(&bnd, i, &file_size, &name);
+      check += file_size + (unsigned char) name[0];
+    }
+  }
+  double walk_time = get_time() - start;
+
+  // find every file by name (the first find builds the index)
+  int n_bad = 0;
+  char name[BENCH_NAME_LEN];
+  start = get_time();
+  for (uint32_t i = 0; i < bnd.n_files; i++) {
+    uint32_t file_num;
+    make_name(name, i);
+    if (bnd_find(&bnd, name, &file_num) != 0 || file_num != i)
+      n_bad++;
+  }
+  double find_time = get_time() - start;
+
+  double n_walked = (double) bnd.n_files * BENCH_ITERATIONS;
+  printf("%-16s  walk %6.2f ns/file  find %7.1f ns/file  (%lu files, check %llx)\n",
+         label, walk_time / n_walked * 1.0e9, find_time / bnd.n_files * 1.0e9,
+         (unsigned long) bnd.n_files, (unsigned long long) check);
+  if (n_bad > 0)
+    printf("* ERROR: %d files not found\n", n_bad);
+
+  bnd_close(&bnd);
+  free(data);
+  return (n_bad > 0) ? 1 : 0;
+}
+
+int main(void)
+{
+  size_t size = 0;
+  int ret = 0;
+  unsigned char *data;
+
+  data = make_bnd3(BENCH_FILES, 0x74000000, &size);
+  ret |= bench_bnd("BND3 LE 0x18", data, size);
+  data = make_bnd3(BENCH_FILES, 0x2E010100, &size);
+  ret |= bench_bnd("BND3 BE 0x18", data, size);
+  data = make_bnd4(BENCH_FILES, &size);
+  ret |= bench_bnd("BND4 LE u32", data, size);
+  return ret;
+}
@@ -8,30 +8,39 @@
 #include "dcx.h"
 #include "reader.h"
 #include "dump.h"
+#include "verify.h"
+#include "sched.h"
+#include "writer.h"
 #include "util.h"
 
 #define MODE_LIST    0
 #define MODE_EXTRACT 1
 #define MODE_DUMP    2
+#define MODE_VERIFY  3
+#define MODE_CREATE  4
 
-#define FLAG_INFLATE  (1<<0)
+#define FLAG_INFLATE   (1<<0)
+#define FLAG_COMPRESS  (1<<1)
+#define FLAG_TAR       (1<<2)
 
-static int write_file(const char *filename, void *data, size_t data_size)
-{
-  FILE *f = fopen(filename, "wb");
-  if (! f)
-    return 1;
+#define FILE_NOT_FOUND  UINT32_MAX
 
-  if (fwrite(data, 1, data_size, f) != data_size) {
-    fclose(f);
-    return 1;
-  }
-
-  fclose(f);
-  return 0;
-}
+struct BND_JOB {
+  struct BND_FILE *f;
+  struct DCX_CONTEXT *dcx;
+  struct WRITER *writer;
+  uint32_t *file_nums;      // file of each item, or FILE_NOT_FOUND
+  unsigned char *copy;      // set for items extracted with writer_copy()
+  char **names;             // names given in the command line, or NULL
+  int mode;
+  int flags;
+  int ret;
+};
 
-static void extract_file(const char *in_filename, void *data, size_t size, int inflated)
+/*
+ * Get the path to extract a file to, or NULL if it can't be extracted.
+ */
+static const char *get_extract_name(const char *in_filename)
 {
   const char *colon = strchr(in_filename, ':');
   if (colon)
@@ -39,57 +48,33 @@ static void extract_file(const char *in_filename, void *data, size_t size, int i
 
   while (*in_filename == '\\')
     in_filename++;
-  
-  if (strstr(in_filename, "..") != NULL) {
-    printf("Refusing to extract file containing '..' in name ('%s')\n", in_filename);
-    return;
-  }
-
-  char *filename = malloc(strlen(in_filename) + 1);
-  if (! filename) {
-    printf("Out of memory to extract file '%s'\n", in_filename);
-    return;
-  }
-  strcpy(filename, in_filename);
-
-  // remove '.dcx' extension if file was inflated
-  if (inflated) {
-    char *dot = strrchr(filename, '.');
-    if (dot && strcmp(dot, ".dcx") == 0) {
-      *dot = '\0';
-    }
-  }
-
-  // convert backslashes to slashes
-  for (char *p = filename; *p != '\0'; p++) {
-    if (*p == '\\')
-      *p = '/';
-  }
-  
-  printf("-> extracting '%s'\n", filename);
 
-  // create directory
-  char *slash = strrchr(filename, '/');
-  if (slash) {
-    *slash = '\0';
-    if (mkdir_p(filename, 0777) != 0)
-      printf("Can't create directory '%s'\n", filename);
-    *slash = '/';
-  }
+  return in_filename;
+}
 
-  // write file
-  if (write_file(filename, data, size) != 0) {
-    printf("ERROR writing '%s'\n", filename);
-  }
+/*
+ * Write the file data to its extraction path.  If 'inflate' is set, the
+ * data is DCX and is inflated while writing.
+ */
+static void extract_file(struct WRITER *writer, const char *in_filename, void *data, size_t size, int inflate)
+{
+  const char *filename = get_extract_name(in_filename);
+  if (filename)
+    writer_extract(writer, filename, data, size, inflate);
 }
 
-static void process_file(const char *filename, void *data, size_t size, int mode, int flags)
+static void process_file(struct DCX_CONTEXT *dcx, struct WRITER *writer, const char *filename, void *data, size_t size, int mode, int flags)
 {
   int inflated = 0;
   size_t orig_size = size;
+  if ((flags & FLAG_INFLATE) && mode == MODE_EXTRACT && size >= 0x40 && memcmp(data, "DCX", 4) == 0) {
+    // inflate while writing, without holding the whole file in memory
+    extract_file(writer, filename, data, size, 1);
+    return;
+  }
   if ((flags & FLAG_INFLATE) && size >= 0x40 && memcmp(data, "DCX", 4) == 0) {
     size_t u_size;
-    void *u_data = dcx_read_mem(data, size, &u_size);
+    void *u_data = dcx_ctx_read_mem(dcx, data, size, &u_size);
     if (! u_data) {
       printf("ERROR inflating '%s'\n", filename);
       return;
@@ -108,7 +93,7 @@ static void process_file(const char *filename, void *data, size_t size, int mode
     break;
     
   case MODE_EXTRACT:
-    extract_file(filename, data, size, inflated);
+    extract_file(writer, filename, data, size, 0);
     break;
     
   case MODE_DUMP:
@@ -116,25 +101,145 @@ static void process_file(const char *filename, void *data, size_t size, int mode
     dump_mem(data, size, 0);
     break;
   }
+}
+
+static const char *get_filename(struct BND_FILE *f, uint32_t file_num, size_t *p_size, char *buf, size_t buf_size)
+{
+  char *filename;
+  bnd_get_file_info(f, file_num, p_size, &filename);
+  if (! filename) {
+    snprintf(buf, buf_size, "%u.dat", (unsigned int) file_num);
+    return buf;
+  }
+  return filename;
+}
+
+/*
+ * Check if a file is extracted as stored in the archive (it's not DCX
+ * or it's not inflated).
+ */
+static int is_stored(struct BND_JOB *job, uint32_t file_num)
+{
+  unsigned char magic[4];
+  if (! (job->flags & FLAG_INFLATE))
+    return 1;
+  return bnd_read_file(job->f, file_num, 0, magic, sizeof(magic)) == 0 && memcmp(magic, "DCX", 4) != 0;
+}
+
+static void copy_job_file(struct BND_JOB *job, uint32_t file_num, const char *filename)
+{
+  uint64_t off;
+  size_t size;
+  const char *extract_name = get_extract_name(filename);
+  if (! extract_name)
+    return;
+  if (bnd_get_file_info(job->f, file_num, &size, NULL) != 0 || bnd_get_file_pos(job->f, file_num, &off) != 0) {
+    printf("ERROR reading '%s'\n", filename);
+    return;
+  }
+  writer_copy(job->writer, extract_name, job->f->fd, off, size);
+}
+
+static int get_job_file_pos(void *user, size_t item, uint64_t *p_off, size_t *p_size)
+{
+  struct BND_JOB *job = user;
+  uint32_t file_num = job->file_nums[item];
+  if (file_num == FILE_NOT_FOUND
+      || bnd_get_file_info(job->f, file_num, p_size, NULL) != 0
+      || bnd_get_file_pos(job->f, file_num, p_off) != 0)
+    return 1;
+  return 0;
+}
+
+static int check_job_file(void *user, size_t item, size_t size)
+{
+  struct BND_JOB *job = user;
+  if (job->mode == MODE_EXTRACT && size >= WRITER_COPY_MIN_SIZE && is_stored(job, job->file_nums[item])) {
+    // copied straight from the archive when processed, nothing to read now
+    job->copy[item] = 1;
+    return 1;
+  }
+  return 0;
+}
+
+static int read_job_file(void *user, size_t item, void *buf, size_t size)
+{
+  struct BND_JOB *job = user;
+  return bnd_read_file(job->f, job->file_nums[item], 0, buf, size);
+}
+
+static void list_file(struct BND_FILE *f, uint32_t file_num, int flags)
+{
+  char filename_buf[256];
+  size_t size;
+  const char *filename = get_filename(f, file_num, &size, filename_buf, sizeof(filename_buf));
+
+  // only read what's needed: nothing, or the DCX header
+  unsigned char header[0x40];
+  struct DCX_INFO info;
+  if ((flags & FLAG_INFLATE) && size >= sizeof(header)
+      && bnd_read_file(f, file_num, 0, header, sizeof(header)) == 0
+      && memcmp(header, "DCX", 4) == 0) {
+    if (dcx_probe(header, sizeof(header), &info) != 0)
+      printf("ERROR reading DCX header of '%s'\n", filename);
+    else
+      printf("%8lu / %-8lu %s\n", (unsigned long) size, (unsigned long) info.data_size, filename);
+  } else {
+    printf("%8lu %s\n", (unsigned long) size, filename);
+  }
+}
+
+static int process_job_file(void *user, size_t item, void *data, size_t size)
+{
+  struct BND_JOB *job = user;
+  uint32_t file_num = job->file_nums[item];
+  if (file_num == FILE_NOT_FOUND) {
+    printf("File not found: '%s'\n", job->names[item]);
+    job->ret = 1;
+    return 0;
+  }
 
-  if (inflated)
-    free(data);
+  if (job->mode == MODE_LIST) {
+    list_file(job->f, file_num, job->flags);
+    return 0;
+  }
+
+  char filename_buf[256];
+  const char *filename = get_filename(job->f, file_num, NULL, filename_buf, sizeof(filename_buf));
+  if (job->copy[item]) {
+    copy_job_file(job, file_num, filename);
+    return 0;
+  }
+  if (! data) {
+    printf("ERROR reading '%s'\n", filename);
+    return 0;
+  }
+  process_file(job->dcx, job->writer, filename, data, size, job->mode, job->flags);
+  return 0;
 }
 
-static int read_cmdline(int argc, char *argv[], int *p_flags)
+static int read_cmdline(int argc, char *argv[], int *p_flags, int *p_n_args)
 {
-  if (argc != 3) {
-    printf("USAGE: bndtool commands file.bnd\n");
+  int n_args = (argc >= 2 && strchr(argv[1], 't') != NULL) ? 3 : 2;
+  if (argc <= n_args) {
+    printf("USAGE: bndtool commands [out.tar] file.bnd [name...]\n");
     printf("\n");
-    printf("Extract and list the contents of bnd files (BND3 format).\n");
+    printf("Extract and list the contents of bnd files (BND3 and BND4 formats).\n");
     printf("\n");
     printf("Use one of these commands:\n");
     printf("  l    list files\n");
     printf("  d    dump files (hexdump)\n");
     printf("  x    extract files\n");
+    printf("  v    verify files (inflate and checksum all files, without writing anything)\n");
+    printf("  c    create the archive from the files in a directory: bndtool c file.bnd dir\n");
     printf("\n");
     printf("Optional flags for commands:\n");
     printf("  i    inflate extracted or dumped files (if applicable)\n");
+    printf("  z    compress created files as DCX (except '.dcx' files)\n");
+    printf("  t    extract to out.tar instead of a directory (use '-' for stdout)\n");
+    printf("\n");
+    printf("If names are given, only the named files are processed (names are\n");
+    printf("matched ignoring case, the drive prefix and '\\' vs '/').\n");
     exit(1);
   }
 
@@ -145,7 +250,11 @@ static int read_cmdline(int argc, char *argv[], int *p_flags)
     case 'x': mode = MODE_EXTRACT; break;
     case 'l': mode = MODE_LIST; break;
     case 'd': mode = MODE_DUMP; break;
+    case 'v': mode = MODE_VERIFY; break;
+    case 'c': mode = MODE_CREATE; break;
     case 'i': flags |= FLAG_INFLATE; break;
+    case 'z': flags |= FLAG_COMPRESS; break;
+    case 't': flags |= FLAG_TAR; break;
     default:
       printf("Invalid command: '%c'\n", *p);
       exit(1);
@@ -153,40 +262,169 @@ static int read_cmdline(int argc, char *argv[], int *p_flags)
   }
 
   if (mode < 0) {
-    printf("At least one of 'x' or 'l' is required\n");
+    printf("At least one of 'x', 'l', 'd', 'v' or 'c' is required\n");
+    exit(1);
+  }
+  if ((flags & FLAG_TAR) && mode != MODE_EXTRACT) {
+    printf("The 't' flag only works with 'x'\n");
     exit(1);
   }
 
   *p_flags = flags;
+  *p_n_args = n_args;
   return mode;
 }
 
+static int create_bnd(const char *bnd_file, int argc, char *argv[], int flags)
+{
+  if (argc != 4) {
+    printf("USAGE: bndtool c file.bnd dir\n");
+    return 1;
+  }
+
+  // names are like the game's: "N:\dir\file"
+  struct PACK_FILE *files;
+  uint32_t n_files;
+  if (pack_list_dir(argv[3], "N:\\", flags & FLAG_COMPRESS, &files, &n_files) != 0) {
+    printf("Can't read directory '%s'\n", argv[3]);
+    return 1;
+  }
+  int ret = bnd_write(bnd_file, files, n_files, DCX_DEFAULT_LEVEL);
+  if (ret == 0)
+    printf("%u files written to '%s'\n", (unsigned) n_files, bnd_file);
+  pack_free_list(files, n_files);
+  return ret;
+}
+
+static int verify_bnd(struct BND_FILE *f)
+{
+  struct VERIFY_ENTRY *entries = malloc((f->n_files + 1) * sizeof(struct VERIFY_ENTRY));
+  char (*id_names)[16] = malloc((f->n_files + 1) * sizeof(*id_names));
+  if (! entries || ! id_names) {
+    printf("Out of memory\n");
+    free(entries);
+    free(id_names);
+    return 1;
+  }
+
+  for (uint32_t file_num = 0; file_num < f->n_files; file_num++) {
+    char *filename = NULL;
+    size_t size;
+    uint64_t off;
+    if (bnd_get_file_info(f, file_num, &size, &filename) != 0)
+      size = 0;
+    if (! filename) {
+      snprintf(id_names[file_num], sizeof(id_names[file_num]), "%u.dat", (unsigned int) file_num);
+      filename = id_names[file_num];
+    }
+    verify_init_entry(&entries[file_num], filename, NULL, size);
+    if (bnd_get_file_pos(f, file_num, &off) != 0)
+      entries[file_num].out_of_bounds = 1;
+    else
+      entries[file_num].data = f->data + off;
+  }
+
+  size_t n_bad = verify_entries(entries, f->n_files);
+  free(entries);
+  free(id_names);
+  return (n_bad > 0) ? 1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
   int flags;
-  int mode = read_cmdline(argc, argv, &flags);
-  char *bnd_file = argv[2];
+  int n_args;
+  int mode = read_cmdline(argc, argv, &flags, &n_args);
+  char *tar_file = (flags & FLAG_TAR) ? argv[2] : NULL;
+  char *bnd_file = argv[n_args];
+
+  if (mode == MODE_CREATE)
+    return create_bnd(bnd_file, argc, argv, flags);
 
+  // verify needs the whole file, the other modes read files on demand
   struct BND_FILE f;
-  if (bnd_open(&f, bnd_file) != 0) {
+  int ret = (mode == MODE_VERIFY) ? bnd_open(&f, bnd_file) : bnd_open_lazy(&f, bnd_file);
+  if (ret != 0) {
     printf("Can't open '%s'\n", bnd_file);
     return 1;
   }
 
-  for (uint32_t file_num = 0; file_num < f.n_files; file_num++) {
-    char *filename;
-    size_t size;
-    char *data = bnd_get_file(&f, file_num, &size, &filename);
+  if (mode == MODE_VERIFY) {
+    int ret = verify_bnd(&f);
+    bnd_close(&f);
+    return ret;
+  }
 
-    char filename_buf[256];
-    if (! filename) {
-      snprintf(filename_buf, sizeof(filename_buf), "%u.dat", (unsigned int) file_num);
-      filename = filename_buf;
+  struct DCX_CONTEXT dcx;
+  if (dcx_init_context(&dcx) != 0) {
+    bnd_close(&f);
+    return 1;
+  }
+
+  // process the named files, or all files if no names are given
+  char **names = argv + n_args + 1;
+  int n_names = argc - n_args - 1;
+  uint32_t n_items = (n_names > 0) ? (uint32_t) n_names : f.n_files;
+  uint32_t *file_nums = malloc((n_items + 1) * sizeof(uint32_t));
+  unsigned char *copy = calloc(n_items + 1, 1);
+  if (! file_nums || ! copy) {
+    free(file_nums);
+    free(copy);
+    printf("Out of memory\n");
+    dcx_free_context(&dcx);
+    bnd_close(&f);
+    return 1;
+  }
+  for (uint32_t item = 0; item < n_items; item++) {
+    file_nums[item] = item;
+    if (n_names > 0 && bnd_find(&f, names[item], &file_nums[item]) != 0)
+      file_nums[item] = FILE_NOT_FOUND;
+  }
+
+  struct WRITER writer;
+  writer_init(&writer);
+  if (tar_file && writer_open_tar(&writer, tar_file) != 0) {
+    printf("Can't create '%s'\n", tar_file);
+    free(file_nums);
+    free(copy);
+    dcx_free_context(&dcx);
+    bnd_close(&f);
+    return 1;
+  }
+  struct BND_JOB job = {
+    .f = &f,
+    .dcx = &dcx,
+    .writer = &writer,
+    .file_nums = file_nums,
+    .copy = copy,
+    .names = names,
+    .mode = mode,
+    .flags = flags,
+    .ret = 0,
+  };
+  if (mode == MODE_LIST || f.fd < 0) {
+    // nothing to read, or the data is already in memory
+    for (uint32_t item = 0; item < n_items; item++) {
+      size_t size = 0;
+      void *data = NULL;
+      if (mode != MODE_LIST && file_nums[item] != FILE_NOT_FOUND)
+        data = bnd_get_file(&f, file_nums[item], &size, NULL);
+      process_job_file(&job, item, data, size);
     }
-    
-    process_file(filename, data, size, mode, flags);
+  } else {
+    // read the files in the order they're stored in the BND
+    if (sched_run(n_items, f.fd, get_job_file_pos, check_job_file, read_job_file, process_job_file, &job) != 0)
+      job.ret = 1;
   }
-  
+  ret = job.ret;
+  free(file_nums);
+  free(copy);
+  if (writer_close(&writer) != 0) {
+    printf("ERROR writing '%s'\n", tar_file);
+    ret = 1;
+  }
+
+  dcx_free_context(&dcx);
   bnd_close(&f);
-  return 0;
+  return ret;
 }
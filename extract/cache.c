@@ -0,0 +1,210 @@
+/* cache.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef _WIN32
+
+#include <process.h>
+#include <sys/types.h>
+#include <sys/utime.h>
+#include <sys/stat.h>
+
+#define getpid _getpid
+#define utime _utime
+
+#else
+
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#endif
+
+#include "cache.h"
+#include "thread.h"
+#include "util.h"
+
+#define CACHE_DEFAULT_SIZE_MB  1024
+#define CACHE_KEY_LEN          (16 + 1 + 8 + 4)   // "<hash>-<comp_size>.dat"
+
+struct CACHE_FILE {
+  char *path;
+  time_t time;
+  size_t size;
+};
+
+struct CACHE_SCAN {
+  struct CACHE_FILE *files;
+  size_t n_files;
+  size_t alloc_files;
+  double total_size;
+};
+
+// bytes written by this thread since the last eviction check
+static THREAD_LOCAL size_t written_since_evict;
+static THREAD_LOCAL int evict_checked;
+
+static const char *get_cache_dir(void)
+{
+  const char *dir = getenv("DCX_CACHE_DIR");
+  if (! dir || dir[0] == '\0')
+    return NULL;
+  return dir;
+}
+
+static double get_cache_max_size(void)
+{
+  const char *size = getenv("DCX_CACHE_SIZE");
+  double mb = (size) ? atof(size) : 0;
+  if (mb <= 0)
+    mb = CACHE_DEFAULT_SIZE_MB;
+  return mb * 1024 * 1024;
+}
+
+int cache_enabled(void)
+{
+  return get_cache_dir() != NULL;
+}
+
+static char *get_cache_path(const char *dir, uint64_t hash, size_t comp_size, const char *suffix)
+{
+  char *path = malloc(strlen(dir) + 1 + CACHE_KEY_LEN + strlen(suffix) + 1);
+  if (! path)
+    return NULL;
+  sprintf(path, "%s/%016llx-%08lx.dat%s", dir,
+          (unsigned long long) hash, (unsigned long) comp_size, suffix);
+  return path;
+}
+
+int cache_read(uint64_t hash, size_t comp_size, void *data, size_t size)
+{
+  const char *dir = get_cache_dir();
+  if (! dir)
+    return 1;
+  char *path = get_cache_path(dir, hash, comp_size, "");
+  if (! path)
+    return 1;
+
+  int ret = 1;
+  FILE *f = fopen(path, "rb");
+  if (f) {
+    // the file must have exactly the expected size
+    if (fread(data, 1, size, f) == size && fgetc(f) == EOF)
+      ret = 0;
+    fclose(f);
+  }
+
+  // mark as recently used
+  if (ret == 0)
+    utime(path, NULL);
+
+  free(path);
+  return ret;
+}
+
+static int add_cache_file(void *data, const char *path)
+{
+  struct CACHE_SCAN *scan = data;
+
+  size_t len = strlen(path);
+  if (len < 4 || strcmp(path + len - 4, ".dat") != 0)
+    return 0;
+
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return 0;
+
+  if (scan->n_files == scan->alloc_files) {
+    size_t alloc = (scan->alloc_files > 0) ? 2*scan->alloc_files : 256;
+    struct CACHE_FILE *files = realloc(scan->files, alloc * sizeof(struct CACHE_FILE));
+    if (! files)
+      return 1;
+    scan->files = files;
+    scan->alloc_files = alloc;
+  }
+  char *copy = malloc(len + 1);
+  if (! copy)
+    return 1;
+  strcpy(copy, path);
+
+  struct CACHE_FILE *file = &scan->files[scan->n_files++];
+  file->path = copy;
+  file->time = st.st_mtime;
+  file->size = st.st_size;
+  scan->total_size += st.st_size;
+  return 0;
+}
+
+static int compare_cache_files(const void *a, const void *b)
+{
+  const struct CACHE_FILE *fa = a;
+  const struct CACHE_FILE *fb = b;
+  if (fa->time < fb->time) return -1;
+  if (fa->time > fb->time) return 1;
+  return 0;
+}
+
+/*
+ * Remove least recently used files until the cache fits in its
+ * maximum size.
+ */
+static void evict(const char *dir)
+{
+  struct CACHE_SCAN scan = { NULL, 0, 0, 0 };
+
+  double max_size = get_cache_max_size();
+  if (list_dir(dir, add_cache_file, &scan) == 0 && scan.total_size > max_size) {
+    qsort(scan.files, scan.n_files, sizeof(struct CACHE_FILE), compare_cache_files);
+    for (size_t i = 0; i < scan.n_files && scan.total_size > max_size; i++) {
+      if (remove(scan.files[i].path) == 0)
+        scan.total_size -= scan.files[i].size;
+    }
+  }
+
+  for (size_t i = 0; i < scan.n_files; i++)
+    free(scan.files[i].path);
+  free(scan.files);
+}
+
+void cache_write(uint64_t hash, size_t comp_size, const void *data, size_t size)
+{
+  const char *dir = get_cache_dir();
+  if (! dir)
+    return;
+
+  // write to a temporary file and rename it, so readers never see partial files
+  char suffix[64];
+  snprintf(suffix, sizeof(suffix), ".%lu-%p.tmp", (unsigned long) getpid(), (void *) &written_since_evict);
+  char *tmp_path = get_cache_path(dir, hash, comp_size, suffix);
+  char *path = get_cache_path(dir, hash, comp_size, "");
+  if (! tmp_path || ! path)
+    goto out;
+
+  FILE *f = fopen(tmp_path, "wb");
+  if (! f)
+    goto out;
+  int ok = (fwrite(data, 1, size, f) == size);
+  if (fclose(f) != 0)
+    ok = 0;
+  if (! ok || replace_file(tmp_path, path) != 0) {
+    remove(tmp_path);
+    goto out;
+  }
+
+  // check the cache size on the first write and then every time
+  // this thread wrote 1/16 of the maximum
+  written_since_evict += size;
+  if (! evict_checked || written_since_evict > get_cache_max_size() / 16) {
+    evict_checked = 1;
+    written_since_evict = 0;
+    evict(dir);
+  }
+
+ out:
+  free(tmp_path);
+  free(path);
+}
@@ -0,0 +1,24 @@
+/* cache.h */
+
+#ifndef CACHE_H_FILE
+#define CACHE_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Optional on-disk cache of decompressed data, enabled by setting
+ * the environment variable DCX_CACHE_DIR to an existing directory.
+ * DCX_CACHE_SIZE sets the maximum cache size in MB (default 1024),
+ * and the least recently used files are removed to stay under it.
+ *
+ * Entries are keyed by a hash and the size of the compressed data.
+ */
+
+#define CACHE_MIN_DATA_SIZE  0x4000   // smaller data is faster to inflate than to read from cache
+
+int cache_enabled(void);
+int cache_read(uint64_t hash, size_t comp_size, void *data, size_t size);
+void cache_write(uint64_t hash, size_t comp_size, const void *data, size_t size);
+
+#endif /* CACHE_H_FILE */
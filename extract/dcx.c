@@ -4,10 +4,97 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
 
+#include "dcx.h"
+#include "cache.h"
+#include "hash.h"
 #include "reader.h"
+#include "inflate.h"
+#include "thread.h"
 #include "zlib.h"
 
+#define EDGE_TABLE_OFFSET  0x70
+#define EDGE_BLOCK_SIZE    0x10000
+#define EDGE_MAX_BLOCK     0x100000  // bigger EDGE blocks are rejected (bounds the stream window)
+
+#define STREAM_IN_SIZE     0x4000    // compressed data read at once when streaming
+#define STREAM_OUT_SIZE    0x40000   // decompressed window written at once when streaming
+#define STREAM_EDGE_BLOCKS 32        // EDGE blocks decompressed at once when streaming
+
+#define DFLT_HEADER_SIZE   0x4c
+#define DEFLATE_BLOCK_SIZE 0x20000   // input compressed by each job when writing
+#define DEFLATE_DICT_SIZE  0x8000
+
+struct EDGE_JOB {
+  const unsigned char *table;
+  const unsigned char *comp;
+  size_t comp_size;
+  unsigned char *out;
+  size_t out_size;
+  size_t block_size;
+  struct INFLATER **inflaters;  // one for each worker, created on first use
+};
+
+struct EDGE_TABLE {
+  unsigned char *blocks;     // 16 bytes per block: 0, offset, size, compressed flag
+  uint32_t n_blocks;
+  size_t block_size;
+  size_t data_off;
+};
+
+struct DEFLATE_JOB {
+  const unsigned char *in;
+  size_t in_size;
+  int level;
+  unsigned char *out;        // out_stride bytes for each block
+  size_t out_stride;
+  size_t *out_sizes;
+  uLong *adlers;
+};
+
+// where to put the decompressed data
+struct DCX_OUTPUT {
+  struct DCX_CONTEXT *ctx;   // if not NULL, use the context buffers
+  void *buf;                 // if not NULL, use this caller buffer
+  size_t buf_size;
+};
+
+static THREAD_LOCAL char *error_buf;
+static THREAD_LOCAL size_t error_buf_size;
+
+/*
+ * Capture error messages of the calling thread in 'buf' instead of
+ * printing them (only the first error is kept).  Use NULL to print
+ * them again.
+ */
+void dcx_set_error_buffer(char *buf, size_t size)
+{
+  error_buf = buf;
+  error_buf_size = size;
+  if (buf && size > 0)
+    buf[0] = '\0';
+}
+
+static void dcx_error(const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  if (! error_buf)
+    vprintf(fmt, ap);
+  else if (error_buf_size > 0 && error_buf[0] == '\0')
+    vsnprintf(error_buf, error_buf_size, fmt, ap);
+  va_end(ap);
+}
+
+static void put_u32_be(unsigned char *p, uint32_t val)
+{
+  p[0] = val >> 24;
+  p[1] = val >> 16;
+  p[2] = val >> 8;
+  p[3] = val;
+}
+
 static int deflate_stream(struct READER reader, void *out, size_t out_size)
 {
   int ret;
@@ -29,7 +116,7 @@ static int deflate_stream(struct READER reader, void *out, size_t out_size)
     size_t size = reader.read(&reader.r, in_buf, sizeof(in_buf));
     if (size == SIZE_MAX) {
       (void) inflateEnd(&strm);
-      printf("* ERROR reading file\n");
+      dcx_error("* ERROR reading file\n");
       return 1;
     }
     strm.avail_in = size;
@@ -43,11 +130,11 @@ static int deflate_stream(struct READER reader, void *out, size_t out_size)
     case Z_DATA_ERROR:
     case Z_MEM_ERROR:
       inflateEnd(&strm);
-      printf("* ERROR: inflate returns %d\n", ret);
+      dcx_error("* ERROR: inflate returns %d\n", ret);
       return 1;
     }
     if (strm.avail_out == 0 && ret != Z_STREAM_END) {
-      printf("* ERROR: decompressed size is too big\n");
+      dcx_error("* ERROR: decompressed size is too big\n");
       inflateEnd(&strm);
       return 1;
     }
@@ -57,68 +144,839 @@ static int deflate_stream(struct READER reader, void *out, size_t out_size)
   return (ret == Z_STREAM_END) ? 0 : 1;
 }
 
-static void *dcx_read(struct READER reader, size_t *p_out_size)
+static int inflate_edge_block(void *data, int worker_num, size_t block_num)
 {
-  unsigned char header[64];
-  if (reader.read(&reader.r, header, sizeof(header)) != sizeof(header)) {
-    printf("* ERROR: can't read header\n");
-    return NULL;
+  struct EDGE_JOB *job = data;
+
+  const unsigned char *entry = job->table + 16*block_num;
+  size_t in_off = get_u32_be(entry, 4);
+  size_t in_size = get_u32_be(entry, 8);
+  uint32_t compressed = get_u32_be(entry, 12);
+
+  size_t out_off = block_num * job->block_size;
+  size_t out_size = job->out_size - out_off;
+  if (out_size > job->block_size)
+    out_size = job->block_size;
+
+  if (in_off > job->comp_size || in_size > job->comp_size - in_off) {
+    dcx_error("* ERROR: EDGE block %u is out of bounds\n", (unsigned) block_num);
+    return 1;
   }
-  if (memcmp(header, "DCX", 3) != 0) {
-    printf("* ERROR: bad file magic\n");
-    return NULL;
+
+  if (! compressed) {
+    if (in_size != out_size) {
+      dcx_error("* ERROR: bad size for stored EDGE block %u\n", (unsigned) block_num);
+      return 1;
+    }
+    memcpy(job->out + out_off, job->comp + in_off, out_size);
+    return 0;
+  }
+
+  // the worker's inflater is reset for each block, like the DFLT one
+  struct INFLATER **inf = &job->inflaters[worker_num];
+  if (! *inf)
+    *inf = inflater_new();
+  if (! *inf || inflater_raw(*inf, job->comp + in_off, in_size, job->out + out_off, out_size) != 0) {
+    dcx_error("* ERROR inflating EDGE block %u\n", (unsigned) block_num);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Inflaters for the workers decompressing 'n_blocks' EDGE blocks (or
+ * fewer, in windows).  They're kept in the context if there's one, so
+ * they're reused for the next files, or freed by put_edge_inflaters().
+ */
+static struct INFLATER **get_edge_inflaters(struct DCX_CONTEXT *ctx, size_t n_blocks, int *p_n_workers)
+{
+  int n_workers = get_parallel_workers(n_blocks);
+  *p_n_workers = n_workers;
+  if (! ctx) {
+    struct INFLATER **inflaters = calloc(n_workers, sizeof(struct INFLATER *));
+    if (! inflaters)
+      dcx_error("* ERROR: out of memory\n");
+    return inflaters;
   }
 
-  if (memcmp(header + 0x28, "DFLT", 4) == 0) {
-    uint32_t start_off = get_u32_be(header, 0x14) + 0x20;
-    size_t data_size = get_u32_be(header, 0x1c);
-    //uint32_t comp_size = get_u32_be(header, 0x20);
-    if (reader.set_pos(&reader.r, start_off) != 0) {
-      printf("* ERROR: can't seek to position %u\n", start_off);
+  if (n_workers > ctx->n_edge_inflaters) {
+    struct INFLATER **inflaters = realloc(ctx->edge_inflaters, n_workers * sizeof(struct INFLATER *));
+    if (! inflaters) {
+      dcx_error("* ERROR: out of memory\n");
       return NULL;
     }
-    //printf("decompressing from offset %u (0x%x)\n", start_off, start_off);
-    void *data = malloc(data_size);
-    if (! data) {
-      printf("* ERROR: out of memory\n");
+    for (int i = ctx->n_edge_inflaters; i < n_workers; i++)
+      inflaters[i] = NULL;
+    ctx->edge_inflaters = inflaters;
+    ctx->n_edge_inflaters = n_workers;
+  }
+  return ctx->edge_inflaters;
+}
+
+static void free_edge_inflaters(struct INFLATER **inflaters, int n_workers)
+{
+  if (! inflaters)
+    return;
+  for (int i = 0; i < n_workers; i++)
+    inflater_free(inflaters[i]);
+  free(inflaters);
+}
+
+static void put_edge_inflaters(struct DCX_CONTEXT *ctx, struct INFLATER **inflaters, int n_workers)
+{
+  if (! ctx)
+    free_edge_inflaters(inflaters, n_workers);
+}
+
+static void *grow_buffer(void **p_buf, size_t *p_buf_size, size_t size)
+{
+  if (size <= *p_buf_size)
+    return *p_buf;
+
+  size_t new_size = *p_buf_size * 2;
+  if (new_size < size)
+    new_size = size;
+  void *buf = realloc(*p_buf, new_size);
+  if (! buf)
+    return NULL;
+  *p_buf = buf;
+  *p_buf_size = new_size;
+  return buf;
+}
+
+static void *alloc_output(struct DCX_OUTPUT *out, size_t size)
+{
+  if (out->buf) {
+    if (size > out->buf_size) {
+      dcx_error("* ERROR: output buffer too small (%lu bytes needed)\n", (unsigned long) size);
       return NULL;
     }
-    if (deflate_stream(reader, data, data_size) != 0) {
-      printf("* ERROR decompressing\n");
-      free(data);
+    return out->buf;
+  }
+
+  if (out->ctx) {
+    void *data = grow_buffer(&out->ctx->data, &out->ctx->data_size, size + 1);
+    if (! data)
+      dcx_error("* ERROR: out of memory\n");
+    return data;
+  }
+
+  void *data = malloc(size + 1);
+  if (! data)
+    dcx_error("* ERROR: out of memory\n");
+  return data;
+}
+
+static void free_output(struct DCX_OUTPUT *out, void *data)
+{
+  if (! out->buf && ! out->ctx)
+    free(data);
+}
+
+/*
+ * Return a pointer to 'size' bytes of compressed data at 'pos', either
+ * directly from the reader if it's in memory or read into a temporary
+ * buffer (owned by the context if there is one, otherwise returned in
+ * '*p_free' to be freed by the caller).
+ */
+static const void *get_comp_data(struct READER *reader, struct DCX_CONTEXT *ctx, size_t pos, size_t size, void **p_free)
+{
+  *p_free = NULL;
+  const void *comp = reader->get_data(&reader->r, pos, size);
+  if (comp)
+    return comp;
+
+  void *buf;
+  if (ctx)
+    buf = grow_buffer(&ctx->comp, &ctx->comp_size, size + 1);
+  else
+    buf = *p_free = malloc(size + 1);
+  if (! buf)
+    return NULL;
+  if (reader->set_pos(&reader->r, pos) != 0
+      || reader->read(&reader->r, buf, size) != size) {
+    free(*p_free);
+    *p_free = NULL;
+    return NULL;
+  }
+  return buf;
+}
+
+static int read_edge_table(struct READER *reader, size_t data_size, struct EDGE_TABLE *t)
+{
+  unsigned char edge_header[EDGE_TABLE_OFFSET - 0x40];
+  if (reader->read(&reader->r, edge_header, sizeof(edge_header)) != sizeof(edge_header)
+      || memcmp(edge_header + 0x4c - 0x40, "EgdT", 4) != 0) {
+    dcx_error("* ERROR: bad EDGE header\n");
+    return 1;
+  }
+  t->data_off = 0x44 + get_u32_be(edge_header, 0x48 - 0x40);
+  t->block_size = get_u32_be(edge_header, 0x5c - 0x40);
+  t->n_blocks = get_u32_be(edge_header, 0x68 - 0x40);
+  if (t->block_size == 0 || t->block_size > EDGE_MAX_BLOCK
+      || (uint64_t) t->n_blocks * t->block_size < data_size
+      || (t->n_blocks > 0 && (uint64_t) (t->n_blocks - 1) * t->block_size >= data_size)
+      || t->data_off < EDGE_TABLE_OFFSET + 16 * (size_t) t->n_blocks) {
+    dcx_error("* ERROR: bad EDGE block table\n");
+    return 1;
+  }
+
+  t->blocks = malloc(16 * (size_t) t->n_blocks + 1);
+  if (! t->blocks) {
+    dcx_error("* ERROR: out of memory\n");
+    return 1;
+  }
+  if (reader->read(&reader->r, t->blocks, 16 * (size_t) t->n_blocks) != 16 * (size_t) t->n_blocks) {
+    dcx_error("* ERROR: can't read EDGE block table\n");
+    free(t->blocks);
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * EDGE files have a table of independently compressed (raw deflate)
+ * blocks of the same uncompressed size (normally EDGE_BLOCK_SIZE), so we inflate
+ * them in parallel straight into their place in the output.
+ */
+static void *dcx_read_edge(struct READER reader, const unsigned char *header, struct DCX_OUTPUT *out, size_t *p_out_size)
+{
+  size_t data_size = get_u32_be(header, 0x1c);
+  size_t comp_size = 0;
+  void *comp_buf = NULL;
+  unsigned char *data = NULL;
+  struct INFLATER **inflaters = NULL;
+  int n_workers = 0;
+
+  struct EDGE_TABLE t;
+  if (read_edge_table(&reader, data_size, &t) != 0)
+    return NULL;
+
+  for (uint32_t i = 0; i < t.n_blocks; i++) {
+    size_t end = (size_t) get_u32_be(t.blocks, 16*i + 4) + get_u32_be(t.blocks, 16*i + 8);
+    if (comp_size < end)
+      comp_size = end;
+  }
+  const unsigned char *comp = get_comp_data(&reader, out->ctx, t.data_off, comp_size, &comp_buf);
+  if (! comp) {
+    dcx_error("* ERROR: can't read compressed data\n");
+    goto err;
+  }
+
+  data = alloc_output(out, data_size);
+  if (! data)
+    goto err;
+
+  inflaters = get_edge_inflaters(out->ctx, t.n_blocks, &n_workers);
+  if (! inflaters)
+    goto err;
+
+  struct EDGE_JOB job;
+  job.table = t.blocks;
+  job.comp = comp;
+  job.comp_size = comp_size;
+  job.out = data;
+  job.out_size = data_size;
+  job.block_size = t.block_size;
+  job.inflaters = inflaters;
+  if (run_parallel_workers(t.n_blocks, inflate_edge_block, &job) != 0) {
+    dcx_error("* ERROR decompressing\n");
+    goto err;
+  }
+
+  put_edge_inflaters(out->ctx, inflaters, n_workers);
+  free(t.blocks);
+  free(comp_buf);
+  *p_out_size = data_size;
+  return data;
+
+ err:
+  put_edge_inflaters(out->ctx, inflaters, n_workers);
+  free(t.blocks);
+  free(comp_buf);
+  if (data)
+    free_output(out, data);
+  return NULL;
+}
+
+/*
+ * DFLT files are a single zlib stream.  We know the compressed size,
+ * so we inflate it in one call directly from the source buffer when
+ * it's in memory (or after reading it in one go when it's not).
+ */
+static void *dcx_read_dflt(struct READER reader, const unsigned char *header, struct DCX_OUTPUT *out, size_t *p_out_size)
+{
+  uint32_t start_off = get_u32_be(header, 0x14) + 0x20;
+  size_t data_size = get_u32_be(header, 0x1c);
+  size_t comp_size = get_u32_be(header, 0x20);
+  void *comp_buf = NULL;
+
+  void *data = alloc_output(out, data_size);
+  if (! data)
+    return NULL;
+
+  const void *comp = (comp_size > 0) ? get_comp_data(&reader, out->ctx, start_off, comp_size, &comp_buf) : NULL;
+  if (comp) {
+    int ret;
+    if (out->ctx)
+      ret = inflater_zlib(out->ctx->inflater, comp, comp_size, data, data_size);
+    else
+      ret = inflate_zlib_mem(comp, comp_size, data, data_size);
+    free(comp_buf);
+    if (ret != 0) {
+      dcx_error("* ERROR decompressing\n");
+      free_output(out, data);
       return NULL;
     }
     *p_out_size = data_size;
     return data;
   }
 
-  if (memcmp(header + 0x28, "EDGE", 4) == 0) {
-    printf("* ERROR: 'EDGE' format not yet supported\n");
+  // bad compressed size or not enough memory: fall back to streaming
+  if (reader.set_pos(&reader.r, start_off) != 0) {
+    dcx_error("* ERROR: can't seek to position %u\n", start_off);
+    free_output(out, data);
+    return NULL;
+  }
+  if (deflate_stream(reader, data, data_size) != 0) {
+    dcx_error("* ERROR decompressing\n");
+    free_output(out, data);
     return NULL;
   }
+  *p_out_size = data_size;
+  return data;
+}
 
-  printf("* ERROR: unknown format: '%.4s'\n", header + 40);
+static void *dcx_read(struct READER reader, struct DCX_OUTPUT *out, size_t *p_out_size)
+{
+  unsigned char header[64];
+  if (reader.read(&reader.r, header, sizeof(header)) != sizeof(header)) {
+    dcx_error("* ERROR: can't read header\n");
+    return NULL;
+  }
+  if (memcmp(header, "DCX", 3) != 0) {
+    dcx_error("* ERROR: bad file magic\n");
+    return NULL;
+  }
+
+  if (memcmp(header + 0x28, "DFLT", 4) == 0)
+    return dcx_read_dflt(reader, header, out, p_out_size);
+
+  if (memcmp(header + 0x28, "EDGE", 4) == 0)
+    return dcx_read_edge(reader, header, out, p_out_size);
+
+  dcx_error("* ERROR: unknown format: '%.4s'\n", header + 40);
   return NULL;
 }
 
-void *dcx_read_file(const char *filename, size_t *p_out_size)
+static void *dcx_read_file_to(struct DCX_OUTPUT *out, const char *filename, size_t *p_out_size)
 {
   FILE *f = fopen(filename, "rb");
   if (! f) {
-    printf("* ERROR: can't open '%s'\n", filename);
+    dcx_error("* ERROR: can't open '%s'\n", filename);
     return NULL;
   }
 
   struct READER file_reader;
   reader_from_file(&file_reader, f);
-  void *data = dcx_read(file_reader, p_out_size);
+  void *data = dcx_read(file_reader, out, p_out_size);
   fclose(f);
   return data;
 }
 
-void *dcx_read_mem(const void *data, size_t size, size_t *p_out_size)
+static void *dcx_read_mem_to(struct DCX_OUTPUT *out, const void *data, size_t size, size_t *p_out_size)
+{
+  // try the cache first
+  struct DCX_INFO info;
+  uint64_t hash = 0;
+  int use_cache = ((! out->ctx || out->ctx->use_cache)
+                   && cache_enabled() && dcx_probe(data, size, &info) == 0
+                   && info.data_size >= CACHE_MIN_DATA_SIZE);
+  if (use_cache) {
+    hash = xxh64(data, size, 0);
+    void *out_data = alloc_output(out, info.data_size);
+    if (! out_data)
+      return NULL;
+    if (cache_read(hash, size, out_data, info.data_size) == 0) {
+      *p_out_size = info.data_size;
+      return out_data;
+    }
+    free_output(out, out_data);
+  }
+
+  struct READER mem_reader;
+  reader_from_memory(&mem_reader, data, size);
+  void *out_data = dcx_read(mem_reader, out, p_out_size);
+  if (out_data && use_cache)
+    cache_write(hash, size, out_data, *p_out_size);
+  return out_data;
+}
+
+// streaming
+
+/*
+ * Inflate a DFLT stream writing each STREAM_OUT_SIZE window to the
+ * output file as soon as it's ready.
+ */
+static int dcx_write_dflt(struct READER reader, const unsigned char *header, FILE *out, size_t *p_out_size)
+{
+  uint32_t start_off = get_u32_be(header, 0x14) + 0x20;
+  size_t data_size = get_u32_be(header, 0x1c);
+  size_t written = 0;
+  unsigned char *in_buf = NULL;
+  unsigned char *out_buf = NULL;
+  int ret;
+  z_stream strm;
+
+  if (reader.set_pos(&reader.r, start_off) != 0) {
+    dcx_error("* ERROR: can't seek to position %u\n", start_off);
+    return 1;
+  }
+
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  strm.avail_in = 0;
+  strm.next_in = Z_NULL;
+  if (inflateInit(&strm) != Z_OK) {
+    dcx_error("* ERROR: can't initialize decompressor\n");
+    return 1;
+  }
+
+  in_buf = malloc(STREAM_IN_SIZE);
+  out_buf = malloc(STREAM_OUT_SIZE);
+  if (! in_buf || ! out_buf) {
+    dcx_error("* ERROR: out of memory\n");
+    goto err;
+  }
+
+  do {
+    if (strm.avail_in == 0) {
+      size_t size = reader.read(&reader.r, in_buf, STREAM_IN_SIZE);
+      if (size == SIZE_MAX) {
+        dcx_error("* ERROR reading file\n");
+        goto err;
+      }
+      if (size == 0) {
+        dcx_error("* ERROR: compressed data is truncated\n");
+        goto err;
+      }
+      strm.next_in = in_buf;
+      strm.avail_in = size;
+    }
+
+    strm.next_out = out_buf;
+    strm.avail_out = STREAM_OUT_SIZE;
+    ret = inflate(&strm, Z_NO_FLUSH);
+    switch (ret) {
+    case Z_NEED_DICT:
+    case Z_DATA_ERROR:
+    case Z_MEM_ERROR:
+      dcx_error("* ERROR: inflate returns %d\n", ret);
+      goto err;
+    }
+
+    size_t size = STREAM_OUT_SIZE - strm.avail_out;
+    if (size > data_size - written) {
+      dcx_error("* ERROR: decompressed size is too big\n");
+      goto err;
+    }
+    if (fwrite(out_buf, 1, size, out) != size) {
+      dcx_error("* ERROR writing output\n");
+      goto err;
+    }
+    written += size;
+  } while (ret != Z_STREAM_END);
+
+  if (written != data_size) {
+    dcx_error("* ERROR: decompressed size is too small\n");
+    goto err;
+  }
+
+  inflateEnd(&strm);
+  free(in_buf);
+  free(out_buf);
+  *p_out_size = written;
+  return 0;
+
+ err:
+  inflateEnd(&strm);
+  free(in_buf);
+  free(out_buf);
+  return 1;
+}
+
+/*
+ * Inflate EDGE blocks in groups of STREAM_EDGE_BLOCKS (in parallel
+ * inside each group), writing each group as soon as it's ready.
+ */
+static int dcx_write_edge(struct READER reader, const unsigned char *header, FILE *out, size_t *p_out_size)
+{
+  size_t data_size = get_u32_be(header, 0x1c);
+  unsigned char *comp = NULL;
+  unsigned char *data = NULL;
+  unsigned char win_table[16 * STREAM_EDGE_BLOCKS];
+  struct INFLATER **inflaters = NULL;
+  int n_workers = 0;
+
+  struct EDGE_TABLE t;
+  if (read_edge_table(&reader, data_size, &t) != 0)
+    return 1;
+
+  // a compressed block bigger than twice its uncompressed size makes no sense
+  size_t max_comp_block_size = 2 * t.block_size;
+  comp = malloc(STREAM_EDGE_BLOCKS * max_comp_block_size);
+  data = malloc(STREAM_EDGE_BLOCKS * t.block_size);
+  inflaters = get_edge_inflaters(NULL, (t.n_blocks < STREAM_EDGE_BLOCKS) ? t.n_blocks : STREAM_EDGE_BLOCKS, &n_workers);
+  if (! comp || ! data || ! inflaters) {
+    dcx_error("* ERROR: out of memory\n");
+    goto err;
+  }
+
+  for (uint32_t first = 0; first < t.n_blocks; first += STREAM_EDGE_BLOCKS) {
+    uint32_t n_blocks = t.n_blocks - first;
+    if (n_blocks > STREAM_EDGE_BLOCKS)
+      n_blocks = STREAM_EDGE_BLOCKS;
+
+    // read compressed blocks of the group
+    size_t comp_size = 0;
+    for (uint32_t i = 0; i < n_blocks; i++) {
+      const unsigned char *entry = t.blocks + 16 * (size_t) (first + i);
+      size_t in_off = get_u32_be(entry, 4);
+      size_t in_size = get_u32_be(entry, 8);
+      if (in_size > max_comp_block_size) {
+        dcx_error("* ERROR: bad size for EDGE block %u\n", (unsigned) (first + i));
+        goto err;
+      }
+      if (reader.set_pos(&reader.r, t.data_off + in_off) != 0
+          || reader.read(&reader.r, comp + comp_size, in_size) != in_size) {
+        dcx_error("* ERROR: can't read compressed data\n");
+        goto err;
+      }
+      memcpy(win_table + 16*i, entry, 16);
+      put_u32_be(win_table + 16*i + 4, comp_size);
+      comp_size += in_size;
+    }
+
+    size_t out_off = (size_t) first * t.block_size;
+    size_t out_size = data_size - out_off;
+    if (out_size > n_blocks * t.block_size)
+      out_size = n_blocks * t.block_size;
+
+    struct EDGE_JOB job;
+    job.table = win_table;
+    job.comp = comp;
+    job.comp_size = comp_size;
+    job.out = data;
+    job.out_size = out_size;
+    job.block_size = t.block_size;
+    job.inflaters = inflaters;
+    if (run_parallel_workers(n_blocks, inflate_edge_block, &job) != 0) {
+      dcx_error("* ERROR decompressing\n");
+      goto err;
+    }
+    if (fwrite(data, 1, out_size, out) != out_size) {
+      dcx_error("* ERROR writing output\n");
+      goto err;
+    }
+  }
+
+  free_edge_inflaters(inflaters, n_workers);
+  free(t.blocks);
+  free(comp);
+  free(data);
+  *p_out_size = data_size;
+  return 0;
+
+ err:
+  free_edge_inflaters(inflaters, n_workers);
+  free(t.blocks);
+  free(comp);
+  free(data);
+  return 1;
+}
+
+static int dcx_write(struct READER reader, FILE *out, size_t *p_out_size)
+{
+  unsigned char header[64];
+  if (reader.read(&reader.r, header, sizeof(header)) != sizeof(header)) {
+    dcx_error("* ERROR: can't read header\n");
+    return 1;
+  }
+  if (memcmp(header, "DCX", 3) != 0) {
+    dcx_error("* ERROR: bad file magic\n");
+    return 1;
+  }
+
+  if (memcmp(header + 0x28, "DFLT", 4) == 0)
+    return dcx_write_dflt(reader, header, out, p_out_size);
+
+  if (memcmp(header + 0x28, "EDGE", 4) == 0)
+    return dcx_write_edge(reader, header, out, p_out_size);
+
+  dcx_error("* ERROR: unknown format: '%.4s'\n", header + 40);
+  return 1;
+}
+
+int dcx_write_file(const char *filename, FILE *out, size_t *p_out_size)
+{
+  FILE *f = fopen(filename, "rb");
+  if (! f) {
+    dcx_error("* ERROR: can't open '%s'\n", filename);
+    return 1;
+  }
+
+  struct READER file_reader;
+  reader_from_file(&file_reader, f);
+  int ret = dcx_write(file_reader, out, p_out_size);
+  fclose(f);
+  return ret;
+}
+
+int dcx_write_mem(const void *data, size_t size, FILE *out, size_t *p_out_size)
 {
   struct READER mem_reader;
   reader_from_memory(&mem_reader, data, size);
-  return dcx_read(mem_reader, p_out_size);
+  return dcx_write(mem_reader, out, p_out_size);
+}
+
+// compression
+
+/*
+ * Compress one block to raw deflate, using the end of the previous
+ * block as dictionary and ending with a sync flush so that all blocks
+ * can be concatenated into a single stream (like pigz does).
+ */
+static int deflate_block(void *data, size_t block_num)
+{
+  struct DEFLATE_JOB *job = data;
+
+  size_t in_off = block_num * DEFLATE_BLOCK_SIZE;
+  size_t in_size = job->in_size - in_off;
+  int last = (in_size <= DEFLATE_BLOCK_SIZE);
+  if (! last)
+    in_size = DEFLATE_BLOCK_SIZE;
+
+  z_stream strm;
+  strm.zalloc = Z_NULL;
+  strm.zfree = Z_NULL;
+  strm.opaque = Z_NULL;
+  if (deflateInit2(&strm, job->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return 1;
+  if (block_num > 0
+      && deflateSetDictionary(&strm, job->in + in_off - DEFLATE_DICT_SIZE, DEFLATE_DICT_SIZE) != Z_OK) {
+    deflateEnd(&strm);
+    return 1;
+  }
+
+  strm.next_in = (unsigned char *) job->in + in_off;
+  strm.avail_in = in_size;
+  strm.next_out = job->out + block_num * job->out_stride;
+  strm.avail_out = job->out_stride;
+  int ret = deflate(&strm, (last) ? Z_FINISH : Z_SYNC_FLUSH);
+  int ok = (last) ? (ret == Z_STREAM_END) : (ret == Z_OK && strm.avail_in == 0 && strm.avail_out > 0);
+  job->out_sizes[block_num] = job->out_stride - strm.avail_out;
+  deflateEnd(&strm);
+  if (! ok) {
+    dcx_error("* ERROR: deflate returns %d\n", ret);
+    return 1;
+  }
+
+  job->adlers[block_num] = adler32(adler32(0, Z_NULL, 0), job->in + in_off, in_size);
+  return 0;
+}
+
+static void write_dflt_header(unsigned char *header, size_t data_size, size_t comp_size, int level)
+{
+  static const unsigned char template[DFLT_HEADER_SIZE] = {
+    'D','C','X', 0,    0, 1, 0, 0,     0, 0, 0, 0x18,  0, 0, 0, 0x24,
+    0, 0, 0, 0x24,     0, 0, 0, 0x2c,  'D','C','S', 0, 0, 0, 0, 0,
+    0, 0, 0, 0,        'D','C','P', 0, 'D','F','L','T', 0, 0, 0, 0x20,
+    0, 0, 0, 0,        0, 0, 0, 0,     0, 0, 0, 0,     0, 0, 0, 0,
+    0, 1, 1, 0,        'D','C','A', 0, 0, 0, 0, 8,
+  };
+  memcpy(header, template, DFLT_HEADER_SIZE);
+  put_u32_be(header + 0x1c, data_size);
+  put_u32_be(header + 0x20, comp_size);
+  header[0x30] = level;
+}
+
+/*
+ * Compress data to a DCX (DFLT) file in memory.  The input is split
+ * in DEFLATE_BLOCK_SIZE blocks compressed in parallel.
+ */
+void *dcx_compress(const void *data, size_t size, int level, size_t *p_out_size)
+{
+  unsigned char *out = NULL;
+  size_t *out_sizes = NULL;
+  uLong *adlers = NULL;
+
+  if (level < 1 || level > 9)
+    level = DCX_DEFAULT_LEVEL;
+  if (size > UINT32_MAX) {
+    dcx_error("* ERROR: data is too big for DCX\n");
+    return NULL;
+  }
+
+  size_t n_blocks = (size + DEFLATE_BLOCK_SIZE - 1) / DEFLATE_BLOCK_SIZE;
+  if (n_blocks == 0)
+    n_blocks = 1;
+  size_t out_stride = compressBound(DEFLATE_BLOCK_SIZE) + 16;
+
+  out = malloc(DFLT_HEADER_SIZE + 2 + n_blocks * out_stride + 4);
+  out_sizes = malloc(n_blocks * sizeof(size_t));
+  adlers = malloc(n_blocks * sizeof(uLong));
+  if (! out || ! out_sizes || ! adlers) {
+    dcx_error("* ERROR: out of memory\n");
+    goto err;
+  }
+
+  struct DEFLATE_JOB job;
+  job.in = data;
+  job.in_size = size;
+  job.level = level;
+  job.out = out + DFLT_HEADER_SIZE + 2;
+  job.out_stride = out_stride;
+  job.out_sizes = out_sizes;
+  job.adlers = adlers;
+  if (run_parallel(n_blocks, deflate_block, &job) != 0) {
+    dcx_error("* ERROR compressing\n");
+    goto err;
+  }
+
+  // stitch blocks together
+  unsigned char *p = out + DFLT_HEADER_SIZE;
+  unsigned int flevel = (level >= 7) ? 3 : (level == 6) ? 2 : (level >= 2) ? 1 : 0;
+  p[0] = 0x78;
+  p[1] = flevel << 6;
+  p[1] += 31 - (p[0] * 256 + p[1]) % 31;
+  p += 2;
+
+  uLong adler = adler32(0, Z_NULL, 0);
+  for (size_t i = 0; i < n_blocks; i++) {
+    memmove(p, job.out + i * out_stride, out_sizes[i]);
+    p += out_sizes[i];
+    size_t block_size = (i == n_blocks-1) ? size - i * DEFLATE_BLOCK_SIZE : DEFLATE_BLOCK_SIZE;
+    adler = adler32_combine(adler, adlers[i], block_size);
+  }
+  put_u32_be(p, adler);
+  p += 4;
+
+  size_t comp_size = p - out - DFLT_HEADER_SIZE;
+  write_dflt_header(out, size, comp_size, level);
+
+  free(out_sizes);
+  free(adlers);
+  *p_out_size = DFLT_HEADER_SIZE + comp_size;
+  return out;
+
+ err:
+  free(out);
+  free(out_sizes);
+  free(adlers);
+  return NULL;
+}
+
+int dcx_compress_file(const char *filename, const void *data, size_t size, int level)
+{
+  size_t comp_size;
+  void *comp = dcx_compress(data, size, level, &comp_size);
+  if (! comp)
+    return 1;
+
+  FILE *f = fopen(filename, "wb");
+  if (! f) {
+    dcx_error("* ERROR: can't create '%s'\n", filename);
+    free(comp);
+    return 1;
+  }
+  int ret = (fwrite(comp, 1, comp_size, f) != comp_size);
+  if (fclose(f) != 0)
+    ret = 1;
+  if (ret != 0)
+    dcx_error("* ERROR writing '%s'\n", filename);
+  free(comp);
+  return ret;
+}
+
+// probe
+
+/*
+ * Read the format and sizes from the header without decompressing.
+ */
+int dcx_probe(const void *data, size_t size, struct DCX_INFO *info)
+{
+  if (size < 0x40 || memcmp(data, "DCX", 3) != 0)
+    return 1;
+
+  if (memcmp((char *) data + 0x28, "DFLT", 4) == 0)
+    info->format = DCX_FORMAT_DFLT;
+  else if (memcmp((char *) data + 0x28, "EDGE", 4) == 0)
+    info->format = DCX_FORMAT_EDGE;
+  else
+    return 1;
+
+  info->data_size = get_u32_be(data, 0x1c);
+  info->comp_size = get_u32_be(data, 0x20);
+  return 0;
+}
+
+// context
+
+int dcx_init_context(struct DCX_CONTEXT *ctx)
+{
+  ctx->data = NULL;
+  ctx->data_size = 0;
+  ctx->comp = NULL;
+  ctx->comp_size = 0;
+  ctx->use_cache = 1;
+  ctx->edge_inflaters = NULL;
+  ctx->n_edge_inflaters = 0;
+  ctx->inflater = inflater_new();
+  if (! ctx->inflater) {
+    dcx_error("* ERROR: can't initialize decompressor\n");
+    return 1;
+  }
+  return 0;
+}
+
+void dcx_free_context(struct DCX_CONTEXT *ctx)
+{
+  inflater_free(ctx->inflater);
+  free_edge_inflaters(ctx->edge_inflaters, ctx->n_edge_inflaters);
+  free(ctx->data);
+  free(ctx->comp);
+}
+
+void *dcx_ctx_read_file(struct DCX_CONTEXT *ctx, const char *filename, size_t *p_out_size)
+{
+  struct DCX_OUTPUT out = { ctx, NULL, 0 };
+  return dcx_read_file_to(&out, filename, p_out_size);
+}
+
+void *dcx_ctx_read_mem(struct DCX_CONTEXT *ctx, const void *data, size_t size, size_t *p_out_size)
+{
+  struct DCX_OUTPUT out = { ctx, NULL, 0 };
+  return dcx_read_mem_to(&out, data, size, p_out_size);
+}
+
+int dcx_ctx_read_mem_into(struct DCX_CONTEXT *ctx, const void *data, size_t size,
+                          void *out_buf, size_t out_buf_size, size_t *p_out_size)
+{
+  struct DCX_OUTPUT out = { ctx, out_buf, out_buf_size };
+  return (dcx_read_mem_to(&out, data, size, p_out_size) != NULL) ? 0 : 1;
+}
+
+// simple interface: returns a malloc()ed buffer
+
+void *dcx_read_file(const char *filename, size_t *p_out_size)
+{
+  struct DCX_OUTPUT out = { NULL, NULL, 0 };
+  return dcx_read_file_to(&out, filename, p_out_size);
+}
+
+void *dcx_read_mem(const void *data, size_t size, size_t *p_out_size)
+{
+  struct DCX_OUTPUT out = { NULL, NULL, 0 };
+  return dcx_read_mem_to(&out, data, size, p_out_size);
 }
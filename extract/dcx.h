@@ -3,6 +3,62 @@
 #ifndef DCX_H_FILE
 #define DCX_H_FILE
 
+#include <stdio.h>
+#include <stddef.h>
+
+struct INFLATER;
+
+#define DCX_FORMAT_DFLT  0
+#define DCX_FORMAT_EDGE  1
+
+#define DCX_DEFAULT_LEVEL  9
+
+struct DCX_INFO {
+  int format;
+  size_t comp_size;
+  size_t data_size;
+};
+
+/*
+ * A decompression context keeps the inflate state and the output
+ * buffer alive between calls, to avoid setup and allocation costs when
+ * decompressing many files.  Data returned by dcx_ctx_read_*() points
+ * to the context buffer, and is only valid until the next call.
+ */
+struct DCX_CONTEXT {
+  struct INFLATER *inflater;
+  struct INFLATER **edge_inflaters;   // for the EDGE block workers, created on first use
+  int n_edge_inflaters;
+  int use_cache;           // use the cache if enabled (see cache.h)
+  void *data;
+  size_t data_size;
+  void *comp;
+  size_t comp_size;
+};
+
+int dcx_init_context(struct DCX_CONTEXT *ctx);
+void dcx_free_context(struct DCX_CONTEXT *ctx);
+void *dcx_ctx_read_file(struct DCX_CONTEXT *ctx, const char *filename, size_t *p_out_size);
+void *dcx_ctx_read_mem(struct DCX_CONTEXT *ctx, const void *data, size_t size, size_t *p_out_size);
+int dcx_ctx_read_mem_into(struct DCX_CONTEXT *ctx, const void *data, size_t size,
+                          void *out_buf, size_t out_buf_size, size_t *p_out_size);
+
+// level is 1-9, use 0 for the default
+void *dcx_compress(const void *data, size_t size, int level, size_t *p_out_size);
+int dcx_compress_file(const char *filename, const void *data, size_t size, int level);
+
+void dcx_set_error_buffer(char *buf, size_t size);
+
+int dcx_probe(const void *data, size_t size, struct DCX_INFO *info);
+
+/*
+ * Decompress to a file in fixed-size windows, without holding the
+ * whole decompressed data in memory.
+ */
+int dcx_write_file(const char *filename, FILE *out, size_t *p_out_size);
+int dcx_write_mem(const void *data, size_t size, FILE *out, size_t *p_out_size);
+
+// return a malloc()ed buffer that must be free()d by the caller
 void *dcx_read_file(const char *filename, size_t *p_out_size);
 void *dcx_read_mem(const void *data, size_t size, size_t *p_out_size);
 
@@ -1,11 +1,198 @@
 /* dcxtool.c */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
 #include <stddef.h>
+#include <string.h>
+#include <stdint.h>
 
 #include "dcx.h"
+#include "inflate.h"
+#include "reader.h"
+#include "thread.h"
+#include "util.h"
+#include "verify.h"
 
-static int write_file(const char *filename, void *data, size_t data_size)
+#define BENCH_DEFAULT_ITERATIONS 10
+
+struct BATCH_FILE {
+  char *in_filename;
+  char *out_filename;
+  int ret;
+  size_t in_size;
+  size_t out_size;
+  char error[256];
+};
+
+struct BATCH {
+  struct BATCH_FILE *files;
+  size_t n_files;
+  size_t alloc_files;
+  int compress;
+  int level;
+  struct DCX_CONTEXT *contexts;   // one for each worker
+};
+
+static int bench_file(const char *filename, int n_iterations, double *p_total_time, double *p_total_bytes)
+{
+  size_t comp_size;
+  void *comp = read_file(filename, &comp_size);
+  if (! comp) {
+    printf("* ERROR: can't read '%s'\n", filename);
+    return 1;
+  }
+
+  struct DCX_CONTEXT dcx;
+  if (dcx_init_context(&dcx) != 0) {
+    free(comp);
+    return 1;
+  }
+
+  double start = get_time();
+  size_t data_size = 0;
+  for (int i = 0; i < n_iterations; i++) {
+    if (! dcx_ctx_read_mem(&dcx, comp, comp_size, &data_size)) {
+      printf("* ERROR: can't inflate '%s'\n", filename);
+      dcx_free_context(&dcx);
+      free(comp);
+      return 1;
+    }
+  }
+  double time = get_time() - start;
+  dcx_free_context(&dcx);
+  free(comp);
+
+  double bytes = (double) data_size * n_iterations;
+  printf("%10lu -> %10lu  %8.1f MB/s  %s\n",
+         (unsigned long) comp_size, (unsigned long) data_size,
+         (time > 0) ? bytes / time / 1.0e6 : 0.0, filename);
+  *p_total_time += time;
+  *p_total_bytes += bytes;
+  return 0;
+}
+
+static int run_benchmark(int argc, char *argv[])
+{
+  int n_iterations = BENCH_DEFAULT_ITERATIONS;
+  int first_file = 2;
+  if (argc > 3 && atoi(argv[2]) > 0) {
+    n_iterations = atoi(argv[2]);
+    first_file = 3;
+  }
+
+  printf("backend: %s, %d iterations\n", inflate_backend_name(), n_iterations);
+  double total_time = 0;
+  double total_bytes = 0;
+  int ret = 0;
+  for (int i = first_file; i < argc; i++)
+    ret |= bench_file(argv[i], n_iterations, &total_time, &total_bytes);
+  if (total_time > 0)
+    printf("total: %.1f MB in %.3f s, %.1f MB/s\n",
+           total_bytes / 1.0e6, total_time, total_bytes / total_time / 1.0e6);
+  return ret;
+}
+
+/*
+ * Report an error to 'error' if given (batch workers keep their errors
+ * to be printed in input order), or print it.
+ */
+static void report_error(char *error, size_t error_size, const char *fmt, ...)
+{
+  va_list ap;
+  va_start(ap, fmt);
+  if (! error) {
+    printf("dcxtool: ");
+    vprintf(fmt, ap);
+  } else if (error_size > 0 && error[0] == '\0') {
+    vsnprintf(error, error_size, fmt, ap);
+  }
+  va_end(ap);
+}
+
+/*
+ * Outputs are written to '<output>.tmp' and renamed when complete, so
+ * that an error never leaves a partial file in place of an existing one.
+ */
+static char *get_tmp_filename(const char *filename)
+{
+  char *tmp_filename = malloc(strlen(filename) + 5);
+  if (tmp_filename)
+    sprintf(tmp_filename, "%s.tmp", filename);
+  return tmp_filename;
+}
+
+static int finish_output(const char *tmp_filename, const char *filename, int ret,
+                         char *error, size_t error_size)
+{
+  if (ret == 0 && replace_file(tmp_filename, filename) != 0) {
+    report_error(error, error_size, "can't write '%s'\n", filename);
+    ret = 1;
+  }
+  if (ret != 0)
+    remove(tmp_filename);
+  return ret;
+}
+
+static int compress_file(const char *in_filename, const char *out_filename, int level,
+                         char *error, size_t error_size)
+{
+  size_t size;
+  void *data = read_file(in_filename, &size);
+  if (! data) {
+    report_error(error, error_size, "can't read '%s'\n", in_filename);
+    return 1;
+  }
+
+  char *tmp_filename = get_tmp_filename(out_filename);
+  if (! tmp_filename) {
+    report_error(error, error_size, "out of memory\n");
+    free(data);
+    return 1;
+  }
+  int ret = dcx_compress_file(tmp_filename, data, size, level);
+  free(data);
+  ret = finish_output(tmp_filename, out_filename, ret, error, error_size);
+  free(tmp_filename);
+  return ret;
+}
+
+static int inflate_file(const char *in_filename, const char *out_filename)
+{
+  // check the input before touching the output
+  unsigned char header[0x40];
+  struct DCX_INFO info;
+  if (read_file_data(in_filename, 0, header, sizeof(header)) != 0) {
+    printf("dcxtool: can't read '%s'\n", in_filename);
+    return 1;
+  }
+  if (dcx_probe(header, sizeof(header), &info) != 0) {
+    printf("dcxtool: '%s' is not a dcx file\n", in_filename);
+    return 1;
+  }
+
+  char *tmp_filename = get_tmp_filename(out_filename);
+  if (! tmp_filename)
+    return 1;
+  FILE *out = fopen(tmp_filename, "wb");
+  if (! out) {
+    printf("dcxtool: can't write '%s'\n", tmp_filename);
+    free(tmp_filename);
+    return 1;
+  }
+
+  size_t data_size;
+  int ret = dcx_write_file(in_filename, out, &data_size);
+  if (fclose(out) != 0 && ret == 0) {
+    printf("dcxtool: can't write '%s'\n", tmp_filename);
+    ret = 1;
+  }
+  ret = finish_output(tmp_filename, out_filename, ret, NULL, 0);
+  free(tmp_filename);
+  return ret;
+}
+
+static int write_file(const char *filename, const void *data, size_t data_size)
 {
   FILE *f = fopen(filename, "wb");
   if (! f)
@@ -16,25 +203,339 @@ static int write_file(const char *filename, void *data, size_t data_size)
     return 1;
   }
 
+  return (fclose(f) != 0) ? 1 : 0;
+}
+
+// batch
+
+static int has_dcx_ext(const char *filename)
+{
+  size_t len = strlen(filename);
+  return len > 4 && strcmp(filename + len - 4, ".dcx") == 0;
+}
+
+/*
+ * Check if a file would be an input of a batch ('file.dcx' to inflate,
+ * or 'file' to compress).  Such a file is never taken as the output of
+ * "in out", so that "dcxtool a.dcx b.dcx" doesn't overwrite b.dcx.
+ */
+static int is_batch_input(const char *filename, int compress)
+{
+  size_t size;
+  if (get_file_size(filename, &size) != 0 || is_dir(filename))
+    return 0;
+  return compress != has_dcx_ext(filename);
+}
+
+static int add_batch_file(void *data, const char *filename)
+{
+  struct BATCH *batch = data;
+
+  if (batch->n_files == batch->alloc_files) {
+    size_t alloc = (batch->alloc_files > 0) ? 2*batch->alloc_files : 64;
+    struct BATCH_FILE *files = realloc(batch->files, alloc * sizeof(struct BATCH_FILE));
+    if (! files)
+      return 1;
+    batch->files = files;
+    batch->alloc_files = alloc;
+  }
+
+  // compress to 'file.dcx', inflate 'file.dcx' to 'file' (or 'file.out')
+  size_t len = strlen(filename);
+  char *out_filename = malloc(len + 5);
+  char *in_filename = malloc(len + 1);
+  if (! out_filename || ! in_filename) {
+    free(out_filename);
+    free(in_filename);
+    return 1;
+  }
+  strcpy(in_filename, filename);
+  strcpy(out_filename, filename);
+  if (batch->compress)
+    strcat(out_filename, ".dcx");
+  else if (has_dcx_ext(filename))
+    out_filename[len - 4] = '\0';
+  else
+    strcat(out_filename, ".out");
+
+  struct BATCH_FILE *file = &batch->files[batch->n_files++];
+  file->in_filename = in_filename;
+  file->out_filename = out_filename;
+  file->ret = 1;
+  file->in_size = 0;
+  file->out_size = 0;
+  file->error[0] = '\0';
+  return 0;
+}
+
+static int add_dir_file(void *data, const char *filename)
+{
+  struct BATCH *batch = data;
+
+  // directories contain both compressed and inflated files
+  if (batch->compress == has_dcx_ext(filename))
+    return 0;
+  return add_batch_file(batch, filename);
+}
+
+static int add_batch_input(struct BATCH *batch, const char *arg);
+
+static int add_list_file(struct BATCH *batch, const char *list_filename)
+{
+  FILE *f = fopen(list_filename, "r");
+  if (! f) {
+    printf("dcxtool: can't open '%s'\n", list_filename);
+    return 1;
+  }
+
+  char line[1024];
+  int ret = 0;
+  while (ret == 0 && fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] != '\0')
+      ret = add_batch_input(batch, line);
+  }
   fclose(f);
+  return ret;
+}
+
+static int add_batch_input(struct BATCH *batch, const char *arg)
+{
+  if (arg[0] == '@')
+    return add_list_file(batch, arg + 1);
+  if (is_dir(arg)) {
+    if (list_dir(arg, add_dir_file, batch) != 0) {
+      printf("dcxtool: can't read directory '%s'\n", arg);
+      return 1;
+    }
+    return 0;
+  }
+  if (add_batch_file(batch, arg) != 0) {
+    printf("dcxtool: out of memory\n");
+    return 1;
+  }
   return 0;
 }
 
-int main(int argc, char *argv[])
+static int process_batch_file(void *data, int worker_num, size_t file_num)
+{
+  struct BATCH *batch = data;
+  struct BATCH_FILE *file = &batch->files[file_num];
+
+  dcx_set_error_buffer(file->error, sizeof(file->error));
+  if (get_file_size(file->in_filename, &file->in_size) != 0) {
+    snprintf(file->error, sizeof(file->error), "can't read file\n");
+    file->ret = 1;
+  } else if (batch->compress) {
+    file->ret = compress_file(file->in_filename, file->out_filename, batch->level,
+                              file->error, sizeof(file->error));
+    if (file->ret == 0 && get_file_size(file->out_filename, &file->out_size) != 0)
+      file->ret = 1;
+  } else {
+    void *out = dcx_ctx_read_file(&batch->contexts[worker_num], file->in_filename, &file->out_size);
+    char *tmp_filename = get_tmp_filename(file->out_filename);
+    if (! out || ! tmp_filename) {
+      file->ret = 1;
+    } else if (write_file(tmp_filename, out, file->out_size) != 0) {
+      snprintf(file->error, sizeof(file->error), "can't write '%s'\n", file->out_filename);
+      remove(tmp_filename);
+      file->ret = 1;
+    } else {
+      file->ret = finish_output(tmp_filename, file->out_filename, 0, file->error, sizeof(file->error));
+    }
+    free(tmp_filename);
+  }
+  dcx_set_error_buffer(NULL, 0);
+  return file->ret;
+}
+
+static void free_batch(struct BATCH *batch)
+{
+  for (size_t i = 0; i < batch->n_files; i++) {
+    free(batch->files[i].in_filename);
+    free(batch->files[i].out_filename);
+  }
+  free(batch->files);
+}
+
+/*
+ * Process all files with a pool of workers, each keeping its own
+ * decompression context.  Results are reported in input order.
+ */
+static int run_batch(int argc, char *argv[], int compress, int level)
 {
-  if (argc != 3) {
-    printf("USAGE: %s in.dcx out\n", argv[0]);
+  struct BATCH batch;
+  batch.files = NULL;
+  batch.n_files = 0;
+  batch.alloc_files = 0;
+  batch.compress = compress;
+  batch.level = level;
+  batch.contexts = NULL;
+
+  for (int i = 0; i < argc; i++) {
+    if (add_batch_input(&batch, argv[i]) != 0) {
+      free_batch(&batch);
+      return 1;
+    }
+  }
+
+  int n_workers = get_parallel_workers(batch.n_files);
+  batch.contexts = malloc(n_workers * sizeof(struct DCX_CONTEXT));
+  if (! batch.contexts) {
+    printf("dcxtool: out of memory\n");
+    free_batch(&batch);
     return 1;
   }
-  
-  size_t data_size;
-  void *data = dcx_read_file(argv[1], &data_size);
-  if (data == NULL)
+  for (int i = 0; i < n_workers; i++) {
+    if (dcx_init_context(&batch.contexts[i]) != 0) {
+      printf("dcxtool: can't initialize decompression\n");
+      while (i-- > 0)
+        dcx_free_context(&batch.contexts[i]);
+      free(batch.contexts);
+      free_batch(&batch);
+      return 1;
+    }
+  }
+
+  double start = get_time();
+  run_parallel_workers(batch.n_files, process_batch_file, &batch);
+  double time = get_time() - start;
+
+  double in_bytes = 0;
+  double out_bytes = 0;
+  size_t n_failed = 0;
+  for (size_t i = 0; i < batch.n_files; i++) {
+    struct BATCH_FILE *file = &batch.files[i];
+    if (file->ret != 0) {
+      printf("FAILED %s: %s", file->in_filename, (file->error[0] != '\0') ? file->error : "error\n");
+      n_failed++;
+    } else {
+      printf("%10lu -> %10lu  %s\n", (unsigned long) file->in_size, (unsigned long) file->out_size, file->out_filename);
+      in_bytes += file->in_size;
+      out_bytes += file->out_size;
+    }
+  }
+  printf("%lu files (%lu failed), %.1f MB -> %.1f MB in %.3f s with %d workers",
+         (unsigned long) batch.n_files, (unsigned long) n_failed,
+         in_bytes / 1.0e6, out_bytes / 1.0e6, time, n_workers);
+  if (time > 0)
+    printf(", %.1f MB/s", ((compress) ? in_bytes : out_bytes) / time / 1.0e6);
+  printf("\n");
+
+  for (int i = 0; i < n_workers; i++)
+    dcx_free_context(&batch.contexts[i]);
+  free(batch.contexts);
+  free_batch(&batch);
+  return (n_failed > 0) ? 1 : 0;
+}
+
+static int run_verify(int argc, char *argv[])
+{
+  struct BATCH batch;
+  batch.files = NULL;
+  batch.n_files = 0;
+  batch.alloc_files = 0;
+  batch.compress = 0;
+
+  for (int i = 0; i < argc; i++) {
+    if (add_batch_input(&batch, argv[i]) != 0) {
+      free_batch(&batch);
+      return 1;
+    }
+  }
+
+  struct VERIFY_ENTRY *entries = malloc((batch.n_files + 1) * sizeof(struct VERIFY_ENTRY));
+  if (! entries) {
+    printf("dcxtool: out of memory\n");
+    free_batch(&batch);
     return 1;
-  
-  if (write_file(argv[2], data, data_size) != 0) {
-    printf("inflate_dcx: can't write '%s'\n", argv[2]);
+  }
+  for (size_t i = 0; i < batch.n_files; i++) {
+    verify_init_entry(&entries[i], batch.files[i].in_filename, NULL, 0);
+    entries[i].filename = batch.files[i].in_filename;
+    entries[i].require_dcx = 1;
+  }
+
+  size_t n_bad = verify_entries(entries, batch.n_files);
+  free(entries);
+  free_batch(&batch);
+  return (n_bad > 0) ? 1 : 0;
+}
+
+static void print_usage(const char *progname)
+{
+  printf("USAGE: %s [-c] [-l level] in out\n", progname);
+  printf("       %s [-c] [-l level] [-j threads] input...\n", progname);
+  printf("       %s -v [-j threads] input...\n", progname);
+  printf("       %s -b [iterations] file.dcx...\n", progname);
+  printf("\n");
+  printf("Inflate or create (with -c) dcx files.\n");
+  printf("\n");
+  printf("Each input can be a file, a directory (processed recursively) or\n");
+  printf("@listfile (a file containing one input per line).  In this mode,\n");
+  printf("'file.dcx' is inflated to 'file' and 'file' is compressed to 'file.dcx'.\n");
+  printf("Two existing files of the same kind ('a.dcx b.dcx') are also a batch.\n");
+  printf("\n");
+  printf("Options:\n");
+  printf("  -c           compress files to DFLT dcx\n");
+  printf("  -l level     compression level (1-9, default %d)\n", DCX_DEFAULT_LEVEL);
+  printf("  -j threads   number of files processed in parallel (default: number of CPUs)\n");
+  printf("  -v           verify files (inflate and checksum, without writing anything)\n");
+  printf("  -b           measure decompression speed of the given files\n");
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc >= 3 && strcmp(argv[1], "-b") == 0)
+    return run_benchmark(argc, argv);
+
+  int compress = 0;
+  int level = DCX_DEFAULT_LEVEL;
+  int n_threads = 0;
+  int verify = 0;
+  int arg = 1;
+  while (arg < argc && argv[arg][0] == '-') {
+    if (strcmp(argv[arg], "-c") == 0) {
+      compress = 1;
+      arg++;
+    } else if (strcmp(argv[arg], "-v") == 0) {
+      verify = 1;
+      arg++;
+    } else if (strcmp(argv[arg], "-l") == 0 && arg+1 < argc) {
+      level = atoi(argv[arg+1]);
+      if (level < 1 || level > 9) {
+        printf("Invalid compression level: '%s'\n", argv[arg+1]);
+        return 1;
+      }
+      arg += 2;
+    } else if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc) {
+      n_threads = atoi(argv[arg+1]);
+      if (n_threads < 1) {
+        printf("Invalid number of threads: '%s'\n", argv[arg+1]);
+        return 1;
+      }
+      set_max_threads(n_threads);
+      arg += 2;
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc - arg < 1) {
+    print_usage(argv[0]);
     return 1;
   }
-  return 0;
+
+  if (verify)
+    return run_verify(argc - arg, argv + arg);
+
+  // "in out" is a single file, anything else is a batch
+  if (n_threads > 0 || argc - arg != 2 || argv[arg][0] == '@' || is_dir(argv[arg])
+      || is_batch_input(argv[arg+1], compress))
+    return run_batch(argc - arg, argv + arg, compress, level);
+
+  if (compress)
+    return compress_file(argv[arg], argv[arg+1], level, NULL, 0);
+  return inflate_file(argv[arg], argv[arg+1]);
 }
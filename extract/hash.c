@@ -0,0 +1,126 @@
+/* hash.c */
+
+#include <string.h>
+
+#ifdef USE_LIBDEFLATE
+#include <libdeflate.h>
+#else
+#include "zlib.h"
+#endif
+
+#include "hash.h"
+
+/*
+ * XXH64 (https://github.com/Cyan4973/xxHash), a fast non-cryptographic
+ * hash.  It processes 32 bytes per round in 4 independent lanes.
+ */
+
+#define PRIME64_1  0x9E3779B185EBCA87ULL
+#define PRIME64_2  0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3  0x165667B19E3779F9ULL
+#define PRIME64_4  0x85EBCA77C2B2AE63ULL
+#define PRIME64_5  0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read_u64(const unsigned char *p)
+{
+  return ((uint64_t) p[0]       | (uint64_t) p[1] << 8  | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24 |
+          (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56);
+}
+
+static inline uint32_t read_u32(const unsigned char *p)
+{
+  return ((uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+  acc += input * PRIME64_2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME64_1;
+}
+
+static inline uint64_t merge_round64(uint64_t acc, uint64_t val)
+{
+  acc ^= round64(0, val);
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed)
+{
+  const unsigned char *p = data;
+  const unsigned char *end = p + len;
+  uint64_t h;
+
+  if (len >= 32) {
+    const unsigned char *limit = end - 32;
+    uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+    uint64_t v2 = seed + PRIME64_2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - PRIME64_1;
+    do {
+      v1 = round64(v1, read_u64(p));
+      v2 = round64(v2, read_u64(p + 8));
+      v3 = round64(v3, read_u64(p + 16));
+      v4 = round64(v4, read_u64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+    h = merge_round64(h, v1);
+    h = merge_round64(h, v2);
+    h = merge_round64(h, v3);
+    h = merge_round64(h, v4);
+  } else {
+    h = seed + PRIME64_5;
+  }
+  h += (uint64_t) len;
+
+  while (p + 8 <= end) {
+    h ^= round64(0, read_u64(p));
+    h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    p += 8;
+  }
+  if (p + 4 <= end) {
+    h ^= (uint64_t) read_u32(p) * PRIME64_1;
+    h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+    p += 4;
+  }
+  while (p < end) {
+    h ^= (*p) * PRIME64_5;
+    h = rotl64(h, 11) * PRIME64_1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+  return h;
+}
+
+/*
+ * CRC32 (as used by zip/gzip).  libdeflate's version uses carryless
+ * multiplication instructions when available, so prefer it.
+ */
+uint32_t crc32_data(const void *data, size_t len)
+{
+#ifdef USE_LIBDEFLATE
+  return libdeflate_crc32(0, data, len);
+#else
+  uint32_t crc = crc32(0, Z_NULL, 0);
+  const unsigned char *p = data;
+  while (len > 0) {
+    uInt n = (len > 0x40000000) ? 0x40000000 : (uInt) len;
+    crc = crc32(crc, p, n);
+    p += n;
+    len -= n;
+  }
+  return crc;
+#endif
+}
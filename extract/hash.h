@@ -0,0 +1,12 @@
+/* hash.h */
+
+#ifndef HASH_H_FILE
+#define HASH_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t xxh64(const void *data, size_t len, uint64_t seed);
+uint32_t crc32_data(const void *data, size_t len);
+
+#endif /* HASH_H_FILE */
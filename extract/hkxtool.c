@@ -3,12 +3,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
-#include "bhd.h"
-#include "dcx.h"
 #include "hkx.h"
-#include "reader.h"
-#include "util.h"
+#include "walk.h"
 
 #define MODE_LIST     0
 #define MODE_EXTRACT  1
@@ -63,69 +61,42 @@ static int process_hkx(void *data, size_t size, const char *filename, int mode,
   return 1;
 }
 
-static int process_single_file(const char *filename, int mode)
-{
-  char magic[4];
-  if (read_file_data(filename, 0, magic, 4) != 0) {
-    printf("Can't open '%s'\n", filename);
-    return 1;
-  }
-
-  size_t size;
-  void *data;
-  if (memcmp(magic, "DCX", 4) == 0) {
-    data = dcx_read_file(filename, &size);
-  } else {
-    data = read_file(filename, &size);
-  }
-  if (! data) {
-    printf("Can't open '%s'\n", filename);
-    return 1;
-  }
-  
+struct HKX_WALK {
+  int mode;
+  size_t n_hkx;
   struct HKX_GEOMETRY g;
-  hkx_init_geometry(&g);
-  process_hkx(data, size, filename, mode, &g);
-  int ret = 0;
-  if (mode == MODE_EXTRACT)
-    ret = write_geometry(filename, &g);
-  hkx_free_geometry(&g);
-  
-  free(data);
-  return ret;
-}
+};
 
-static int process_bhd(const char *filename, int mode)
+static int process_leaf(void *user, const char *path, const void *data, size_t size)
 {
-  struct BHD_FILE f;
-  if (bhd_open(&f, filename) != 0) {
-    printf("Can't open '%s'\n", filename);
-    return 1;
-  }
+  struct HKX_WALK *w = user;
 
-  struct HKX_GEOMETRY g;
-  hkx_init_geometry(&g);
-
-  for (uint32_t file_num = 0; file_num < f.n_files; file_num++) {
-    char *hkx_filename;
-    size_t comp_size;
-    char *comp_data = bhd_get_file(&f, file_num, &comp_size, &hkx_filename);
+  if (size < 8 || memcmp((char *) data + 4, "TAG0", 4) != 0)
+    return 0;
+  w->n_hkx++;
+  process_hkx((void *) data, size, path, w->mode, &w->g);
+  return 0;
+}
 
-    size_t size;
-    void *data = dcx_read_mem(comp_data, comp_size, &size);
-    if (! data) {
-      printf("Can't inflate '%s'\n", hkx_filename);
-    } else {
-      process_hkx(data, size, hkx_filename, mode, &g);
-      free(data);
-    }
+/*
+ * Process all hkx files in the given file, which can be a plain or
+ * compressed hkx, or any nesting of bhd/bdt, bnd and dcx containers.
+ */
+static int process_file(const char *filename, int mode)
+{
+  struct HKX_WALK w;
+  w.mode = mode;
+  w.n_hkx = 0;
+  hkx_init_geometry(&w.g);
+
+  int ret = walk_file(filename, process_leaf, &w);
+  if (ret == 0 && w.n_hkx == 0) {
+    printf("No hkx files found in '%s'\n", filename);
+    ret = 1;
   }
-  
-  int ret = 0;
-  if (mode == MODE_EXTRACT)
-    ret = write_geometry(filename, &g);
-  hkx_free_geometry(&g);
-  bhd_close(&f);
+  if (ret == 0 && mode == MODE_EXTRACT)
+    ret = write_geometry(filename, &w.g);
+  hkx_free_geometry(&w.g);
   return ret;
 }
 
@@ -134,8 +105,10 @@ static int read_cmdline(int argc, char *argv[])
   if (argc != 3) {
     printf("USAGE: hkxtool commands file.hkx\n");
     printf("       hkxtool commands file.hkxbhd\n");
+    printf("       hkxtool commands file.bnd\n");
     printf("\n");
-    printf("Extract and list the contents of hkx or hkxbhd/hkxbdt files.\n");
+    printf("Extract and list the contents of hkx files, including hkx files\n");
+    printf("inside (possibly nested and compressed) hkxbhd/hkxbdt and bnd files.\n");
     printf("\n");
     printf("Use one of these commands:\n");
     printf("  l    list files\n");
@@ -166,19 +139,5 @@ static int read_cmdline(int argc, char *argv[])
 int main(int argc, char *argv[])
 {
   int mode = read_cmdline(argc, argv);
-  char *file = argv[2];
-
-  char header[8];
-  if (read_file_data(file, 0, header, 8) != 0) {
-    printf("Can't open '%s'\n", file);
-    return 1;
-  }
-
-  if (memcmp(header, "BHF3", 4) == 0)
-    return process_bhd(file, mode);
-  if (memcmp(header + 4, "TAG0", 4) == 0)
-    return process_single_file(file, mode);
-
-  printf("Unknown format in '%s'\n", file);
-  return 1;
+  return process_file(argv[2], mode);
 }
@@ -0,0 +1,140 @@
+/* inflate.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "inflate.h"
+
+#ifdef USE_LIBDEFLATE
+
+#include <libdeflate.h>
+
+struct INFLATER {
+  struct libdeflate_decompressor *d;
+};
+
+struct INFLATER *inflater_new(void)
+{
+  struct INFLATER *inf = malloc(sizeof(struct INFLATER));
+  if (! inf)
+    return NULL;
+  inf->d = libdeflate_alloc_decompressor();
+  if (! inf->d) {
+    free(inf);
+    return NULL;
+  }
+  return inf;
+}
+
+void inflater_free(struct INFLATER *inf)
+{
+  if (! inf)
+    return;
+  libdeflate_free_decompressor(inf->d);
+  free(inf);
+}
+
+static int inflater_run(struct INFLATER *inf, const void *in, size_t in_size, void *out, size_t out_size, int raw)
+{
+  enum libdeflate_result ret;
+  if (raw)
+    ret = libdeflate_deflate_decompress(inf->d, in, in_size, out, out_size, NULL);
+  else
+    ret = libdeflate_zlib_decompress(inf->d, in, in_size, out, out_size, NULL);
+  return (ret == LIBDEFLATE_SUCCESS) ? 0 : 1;
+}
+
+const char *inflate_backend_name(void)
+{
+  return "libdeflate";
+}
+
+#else
+
+#include "zlib.h"
+
+struct INFLATER {
+  z_stream strm;
+};
+
+struct INFLATER *inflater_new(void)
+{
+  struct INFLATER *inf = malloc(sizeof(struct INFLATER));
+  if (! inf)
+    return NULL;
+  inf->strm.zalloc = Z_NULL;
+  inf->strm.zfree = Z_NULL;
+  inf->strm.opaque = Z_NULL;
+  inf->strm.avail_in = 0;
+  inf->strm.next_in = Z_NULL;
+  if (inflateInit2(&inf->strm, 15) != Z_OK) {
+    free(inf);
+    return NULL;
+  }
+  return inf;
+}
+
+void inflater_free(struct INFLATER *inf)
+{
+  if (! inf)
+    return;
+  inflateEnd(&inf->strm);
+  free(inf);
+}
+
+static int inflater_run(struct INFLATER *inf, const void *in, size_t in_size, void *out, size_t out_size, int raw)
+{
+  if (in_size > UINT32_MAX || out_size > UINT32_MAX)
+    return 1;
+
+  // inflateReset2() keeps the allocated state and window
+  if (inflateReset2(&inf->strm, (raw) ? -15 : 15) != Z_OK)
+    return 1;
+
+  inf->strm.next_in = (unsigned char *) in;
+  inf->strm.avail_in = in_size;
+  inf->strm.next_out = out;
+  inf->strm.avail_out = out_size;
+  int ret = inflate(&inf->strm, Z_FINISH);
+  if (ret != Z_STREAM_END || inf->strm.avail_out != 0)
+    return 1;
+  return 0;
+}
+
+const char *inflate_backend_name(void)
+{
+  return "zlib";
+}
+
+#endif
+
+int inflater_zlib(struct INFLATER *inf, const void *in, size_t in_size, void *out, size_t out_size)
+{
+  return inflater_run(inf, in, in_size, out, out_size, 0);
+}
+
+int inflater_raw(struct INFLATER *inf, const void *in, size_t in_size, void *out, size_t out_size)
+{
+  return inflater_run(inf, in, in_size, out, out_size, 1);
+}
+
+static int inflate_mem(const void *in, size_t in_size, void *out, size_t out_size, int raw)
+{
+  struct INFLATER *inf = inflater_new();
+  if (! inf)
+    return 1;
+  int ret = inflater_run(inf, in, in_size, out, out_size, raw);
+  inflater_free(inf);
+  return ret;
+}
+
+int inflate_zlib_mem(const void *in, size_t in_size, void *out, size_t out_size)
+{
+  return inflate_mem(in, in_size, out, out_size, 0);
+}
+
+int inflate_raw_mem(const void *in, size_t in_size, void *out, size_t out_size)
+{
+  return inflate_mem(in, in_size, out, out_size, 1);
+}
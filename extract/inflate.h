@@ -0,0 +1,30 @@
+/* inflate.h */
+
+#ifndef INFLATE_H_FILE
+#define INFLATE_H_FILE
+
+#include <stddef.h>
+
+/*
+ * Single-shot decompression of a whole in-memory buffer.  The
+ * backend is selected at build time: zlib by default, libdeflate
+ * if USE_LIBDEFLATE is defined.  All decompression functions return
+ * 0 on success, which requires the output to be filled exactly.
+ *
+ * An INFLATER keeps the backend state alive between calls, so it
+ * should be reused when decompressing many buffers.  It must not be
+ * used by more than one thread at a time.
+ */
+
+struct INFLATER;
+
+struct INFLATER *inflater_new(void);
+void inflater_free(struct INFLATER *inf);
+int inflater_zlib(struct INFLATER *inf, const void *in, size_t in_size, void *out, size_t out_size);
+int inflater_raw(struct INFLATER *inf, const void *in, size_t in_size, void *out, size_t out_size);
+
+int inflate_zlib_mem(const void *in, size_t in_size, void *out, size_t out_size);
+int inflate_raw_mem(const void *in, size_t in_size, void *out, size_t out_size);
+const char *inflate_backend_name(void);
+
+#endif /* INFLATE_H_FILE */
@@ -0,0 +1,156 @@
+/* name_index.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "name_index.h"
+
+static const char *skip_prefix(const char *name)
+{
+  const char *colon = strchr(name, ':');
+  if (colon)
+    name = colon + 1;
+  while (*name == '\\' || *name == '/')
+    name++;
+  return name;
+}
+
+static inline unsigned char normalize_char(unsigned char c)
+{
+  if (c == '\\')
+    return '/';
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A' + 'a';
+  return c;
+}
+
+/*
+ * FNV-1a of the normalized name.
+ */
+uint32_t name_hash(const char *name)
+{
+  uint32_t hash = 0x811c9dc5;
+  for (const unsigned char *p = (const unsigned char *) skip_prefix(name); *p != '\0'; p++) {
+    hash ^= normalize_char(*p);
+    hash *= 0x01000193;
+  }
+  return hash;
+}
+
+bool name_equal(const char *a, const char *b)
+{
+  const unsigned char *pa = (const unsigned char *) skip_prefix(a);
+  const unsigned char *pb = (const unsigned char *) skip_prefix(b);
+  while (*pa != '\0' && normalize_char(*pa) == normalize_char(*pb)) {
+    pa++;
+    pb++;
+  }
+  return *pa == *pb;
+}
+
+void name_index_init(struct NAME_INDEX *idx)
+{
+  idx->slots = NULL;
+  idx->hashes = NULL;
+  idx->n_slots = 0;
+}
+
+void name_index_free(struct NAME_INDEX *idx)
+{
+  free(idx->slots);
+  free(idx->hashes);
+  name_index_init(idx);
+}
+
+/*
+ * Build the index with the names of all files.  If several files have
+ * the same name, the first one is found.
+ */
+int name_index_build(struct NAME_INDEX *idx, uint32_t n_files, name_index_func get_name, void *user)
+{
+  name_index_free(idx);
+
+  // keep the load factor at or below 1/2
+  uint32_t n_slots = 16;
+  while (n_slots < 2 * (uint64_t) n_files) {
+    if (n_slots >= 0x80000000u)
+      return 1;
+    n_slots *= 2;
+  }
+
+  idx->slots = calloc(n_slots, sizeof(uint32_t));
+  idx->hashes = malloc(n_slots * sizeof(uint32_t));
+  if (! idx->slots || ! idx->hashes) {
+    name_index_free(idx);
+    return 1;
+  }
+  idx->n_slots = n_slots;
+
+  for (uint32_t file_num = 0; file_num < n_files; file_num++) {
+    const char *name = get_name(user, file_num);
+    if (! name)
+      continue;
+    uint32_t hash = name_hash(name);
+    uint32_t slot = hash & (n_slots - 1);
+    bool dup = false;
+    while (idx->slots[slot] != 0) {
+      if (idx->hashes[slot] == hash && name_equal(name, get_name(user, idx->slots[slot] - 1))) {
+        dup = true;
+        break;
+      }
+      slot = (slot + 1) & (n_slots - 1);
+    }
+    if (dup)
+      continue;
+    idx->slots[slot] = file_num + 1;
+    idx->hashes[slot] = hash;
+  }
+  return 0;
+}
+
+/*
+ * Find a file by name in a built index.  Returns 0 if found.
+ */
+int name_index_find(struct NAME_INDEX *idx, const char *name, name_index_func get_name, void *user, uint32_t *p_file_num)
+{
+  if (idx->n_slots == 0)
+    return 1;
+
+  uint32_t hash = name_hash(name);
+  uint32_t slot = hash & (idx->n_slots - 1);
+  while (idx->slots[slot] != 0) {
+    uint32_t file_num = idx->slots[slot] - 1;
+    if (idx->hashes[slot] == hash && name_equal(name, get_name(user, file_num))) {
+      *p_file_num = file_num;
+      return 0;
+    }
+    slot = (slot + 1) & (idx->n_slots - 1);
+  }
+  return 1;
+}
+
+/*
+ * Skip the drive prefix ("N:") of a name, if it has one.
+ */
+const char *name_skip_drive(const char *name)
+{
+  const char *colon = strchr(name, ':');
+  return (colon) ? colon + 1 : name;
+}
+
+/*
+ * Path hash used by BND4 hash tables and BHD5 buckets: the path is
+ * lowercased with '/' separators and a leading '/'.
+ */
+uint32_t path_hash(const char *name)
+{
+  uint32_t hash = 0;
+  if (*name != '/' && *name != '\\')
+    hash = '/';
+  for (const unsigned char *p = (const unsigned char *) name; *p != '\0'; p++) {
+    hash = hash * 37 + normalize_char(*p);
+  }
+  return hash;
+}
@@ -0,0 +1,35 @@
+/* name_index.h */
+
+#ifndef NAME_INDEX_H_FILE
+#define NAME_INDEX_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Hash table mapping archive file names to file numbers.  Names are
+ * compared normalized: the drive prefix ("N:") and leading slashes are
+ * ignored, case is folded and '\' matches '/'.
+ */
+struct NAME_INDEX {
+  uint32_t *slots;          // file_num+1, or 0 if empty
+  uint32_t *hashes;
+  uint32_t n_slots;         // power of 2, or 0 if not built
+};
+
+/*
+ * Return the name of the file 'file_num', or NULL if it has none.
+ */
+typedef const char *(*name_index_func)(void *user, uint32_t file_num);
+
+void name_index_init(struct NAME_INDEX *idx);
+void name_index_free(struct NAME_INDEX *idx);
+int name_index_build(struct NAME_INDEX *idx, uint32_t n_files, name_index_func get_name, void *user);
+int name_index_find(struct NAME_INDEX *idx, const char *name, name_index_func get_name, void *user, uint32_t *p_file_num);
+uint32_t name_hash(const char *name);
+bool name_equal(const char *a, const char *b);
+const char *name_skip_drive(const char *name);
+uint32_t path_hash(const char *name);
+
+#endif /* NAME_INDEX_H_FILE */
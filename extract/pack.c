@@ -0,0 +1,228 @@
+/* pack.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pack.h"
+#include "dcx.h"
+#include "reader.h"
+#include "thread.h"
+#include "util.h"
+
+struct PACK_RUN {
+  struct PACK_FILE *files;
+  int level;
+};
+
+struct PACK_LIST {
+  const char *dir;
+  const char *prefix;
+  int compress;
+  struct PACK_FILE *files;
+  uint32_t n_files;
+  uint32_t alloc_files;
+};
+
+static int load_file(void *data, size_t file_num)
+{
+  struct PACK_RUN *run = data;
+  struct PACK_FILE *file = &run->files[file_num];
+  void *in_buf = NULL;
+
+  file->out_data = NULL;
+  file->out_size = 0;
+  file->buf = NULL;
+  file->ret = 1;
+
+  const void *in = file->data;
+  size_t in_size = file->size;
+  if (file->filename) {
+    in = in_buf = read_file(file->filename, &in_size);
+    if (! in) {
+      printf("* ERROR: can't read '%s'\n", file->filename);
+      return 1;
+    }
+  }
+
+  if (file->compress) {
+    file->buf = dcx_compress(in, in_size, run->level, &file->out_size);
+    free(in_buf);
+    if (! file->buf) {
+      printf("* ERROR: can't compress '%s'\n", file->name);
+      return 1;
+    }
+    file->out_data = file->buf;
+  } else {
+    file->buf = in_buf;
+    file->out_data = in;
+    file->out_size = in_size;
+  }
+  file->ret = 0;
+  return 0;
+}
+
+/*
+ * Read (and compress, if requested) files in parallel, so that they're
+ * ready to be written in order.  Returns nonzero if any file failed.
+ */
+int pack_load_files(struct PACK_FILE *files, size_t n_files, int level)
+{
+  struct PACK_RUN run;
+  run.files = files;
+  run.level = level;
+  run_parallel(n_files, load_file, &run);
+
+  for (size_t i = 0; i < n_files; i++) {
+    if (files[i].ret != 0)
+      return 1;
+  }
+  return 0;
+}
+
+void pack_release_files(struct PACK_FILE *files, size_t n_files)
+{
+  for (size_t i = 0; i < n_files; i++) {
+    free(files[i].buf);
+    files[i].buf = NULL;
+    files[i].out_data = NULL;
+  }
+}
+
+int pack_write(FILE *f, const void *data, size_t size, uint64_t *p_pos)
+{
+  if (size > 0 && fwrite(data, 1, size, f) != size)
+    return 1;
+  *p_pos += size;
+  return 0;
+}
+
+int pack_write_padding(FILE *f, size_t align, uint64_t *p_pos)
+{
+  static const unsigned char zeros[64];
+  size_t pad = (align - *p_pos % align) % align;
+  while (pad > 0) {
+    size_t len = (pad < sizeof(zeros)) ? pad : sizeof(zeros);
+    if (pack_write(f, zeros, len, p_pos) != 0)
+      return 1;
+    pad -= len;
+  }
+  return 0;
+}
+
+/*
+ * Size of the header and file table of a BND3/BHF3 with the given files
+ * (0x20-byte header, 0x18-byte file definitions and names).
+ */
+size_t pack_toc_size(const struct PACK_FILE *files, uint32_t n_files)
+{
+  size_t size = 0x20 + (size_t) n_files * 0x18;
+  for (uint32_t i = 0; i < n_files; i++)
+    size += strlen(files[i].name) + 1;
+  return size;
+}
+
+/*
+ * Fill the header and file table of a little endian BND3/BHF3 (format
+ * 0x74: ids, names and uncompressed sizes).  'toc' must be zeroed and
+ * have pack_toc_size() bytes.
+ */
+void pack_fill_toc(unsigned char *toc, const char *magic, const struct PACK_FILE *files, uint32_t n_files, const uint32_t *offsets)
+{
+  size_t toc_size = pack_toc_size(files, n_files);
+
+  memcpy(toc, magic, 4);
+  memcpy(toc + 4, "07D7R6", 6);
+  toc[12] = 0x74;
+  put_u32_le(toc, 16, n_files);
+  if (memcmp(magic, "BND3", 4) == 0)
+    put_u32_le(toc, 0x14, toc_size);
+
+  size_t name_off = 0x20 + (size_t) n_files * 0x18;
+  for (uint32_t i = 0; i < n_files; i++) {
+    size_t def = 0x20 + (size_t) i * 0x18;
+    put_u32_le(toc, def + 0x00, 0x40);
+    put_u32_le(toc, def + 0x04, files[i].out_size);
+    put_u32_le(toc, def + 0x08, offsets[i]);
+    put_u32_le(toc, def + 0x0c, i);
+    put_u32_le(toc, def + 0x10, name_off);
+    put_u32_le(toc, def + 0x14, files[i].out_size);
+    strcpy((char *) toc + name_off, files[i].name);
+    name_off += strlen(files[i].name) + 1;
+  }
+}
+
+static int add_file(void *data, const char *path)
+{
+  struct PACK_LIST *list = data;
+
+  if (list->n_files == list->alloc_files) {
+    uint32_t alloc_files = (list->alloc_files == 0) ? 64 : 2 * list->alloc_files;
+    struct PACK_FILE *files = realloc(list->files, alloc_files * sizeof(struct PACK_FILE));
+    if (! files)
+      return 1;
+    list->files = files;
+    list->alloc_files = alloc_files;
+  }
+
+  // archive name: prefix + path relative to dir, with '\' separators
+  const char *rel_path = path + strlen(list->dir);
+  while (*rel_path == '/')
+    rel_path++;
+  size_t len = strlen(rel_path);
+  int compress = (list->compress && ! (len >= 4 && strcmp(rel_path + len - 4, ".dcx") == 0));
+  char *name = malloc(strlen(list->prefix) + len + 5);
+  char *filename = malloc(strlen(path) + 1);
+  if (! name || ! filename) {
+    free(name);
+    free(filename);
+    return 1;
+  }
+  strcpy(filename, path);
+  sprintf(name, "%s%s%s", list->prefix, rel_path, (compress) ? ".dcx" : "");
+  for (char *p = name; *p != '\0'; p++) {
+    if (*p == '/')
+      *p = '\\';
+  }
+
+  struct PACK_FILE *file = &list->files[list->n_files++];
+  memset(file, 0, sizeof(*file));
+  file->name = name;
+  file->filename = filename;
+  file->compress = compress;
+  return 0;
+}
+
+/*
+ * Make the list of files to pack from a directory tree, in alphabetical
+ * order.  If 'compress' is set, files not already ending in '.dcx' are
+ * marked to be compressed and get '.dcx' added to their names.
+ */
+int pack_list_dir(const char *dir, const char *prefix, int compress, struct PACK_FILE **p_files, uint32_t *p_n_files)
+{
+  struct PACK_LIST list;
+  list.dir = dir;
+  list.prefix = prefix;
+  list.compress = compress;
+  list.files = NULL;
+  list.n_files = 0;
+  list.alloc_files = 0;
+
+  if (list_dir(dir, add_file, &list) != 0) {
+    pack_free_list(list.files, list.n_files);
+    return 1;
+  }
+  *p_files = list.files;
+  *p_n_files = list.n_files;
+  return 0;
+}
+
+void pack_free_list(struct PACK_FILE *files, uint32_t n_files)
+{
+  for (uint32_t i = 0; i < n_files; i++) {
+    free((char *) files[i].name);
+    free((char *) files[i].filename);
+  }
+  free(files);
+}
@@ -0,0 +1,40 @@
+/* pack.h */
+
+#ifndef PACK_H_FILE
+#define PACK_H_FILE
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACK_DATA_ALIGN    16   // alignment of file data in written archives
+#define PACK_WRITE_WINDOW  64   // files loaded and compressed at a time
+
+/*
+ * A file to be written to an archive.  The data is read from 'filename'
+ * (or taken from data/size) and DCX-compressed if 'compress' is set.
+ */
+struct PACK_FILE {
+  const char *name;         // name stored in the archive
+  const char *filename;     // file to read, or NULL to use data/size
+  const void *data;
+  size_t size;
+  int compress;
+
+  // set by pack_load_files()
+  const void *out_data;
+  size_t out_size;
+  void *buf;
+  int ret;
+};
+
+int pack_load_files(struct PACK_FILE *files, size_t n_files, int level);
+void pack_release_files(struct PACK_FILE *files, size_t n_files);
+int pack_write(FILE *f, const void *data, size_t size, uint64_t *p_pos);
+int pack_write_padding(FILE *f, size_t align, uint64_t *p_pos);
+size_t pack_toc_size(const struct PACK_FILE *files, uint32_t n_files);
+void pack_fill_toc(unsigned char *toc, const char *magic, const struct PACK_FILE *files, uint32_t n_files, const uint32_t *offsets);
+int pack_list_dir(const char *dir, const char *prefix, int compress, struct PACK_FILE **p_files, uint32_t *p_n_files);
+void pack_free_list(struct PACK_FILE *files, uint32_t n_files);
+
+#endif /* PACK_H_FILE */
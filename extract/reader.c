@@ -5,6 +5,16 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
 #include "reader.h"
 
 void *read_file(const char *filename, size_t *p_size)
@@ -62,6 +72,82 @@ int read_file_data(const char *filename, size_t off, void *data, size_t size)
   return 1;
 }
 
+int get_file_size(const char *filename, size_t *p_size)
+{
+  FILE *f = fopen(filename, "rb");
+  if (! f)
+    return 1;
+
+  long size = -1;
+  if (fseek(f, 0, SEEK_END) == 0)
+    size = ftell(f);
+  fclose(f);
+  if (size < 0)
+    return 1;
+  *p_size = size;
+  return 0;
+}
+
+// positional reads: safe to use from many threads on the same fd
+
+int file_open_read(const char *filename)
+{
+#ifdef _WIN32
+  return _open(filename, _O_RDONLY | _O_BINARY);
+#else
+  return open(filename, O_RDONLY);
+#endif
+}
+
+void file_close(int fd)
+{
+#ifdef _WIN32
+  _close(fd);
+#else
+  close(fd);
+#endif
+}
+
+int file_pread(int fd, void *data, size_t size, uint64_t off)
+{
+  char *p = data;
+  while (size > 0) {
+#ifdef _WIN32
+    OVERLAPPED ov;
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) off;
+    ov.OffsetHigh = (DWORD) (off >> 32);
+    DWORD n_read;
+    DWORD chunk = (size > 0x40000000) ? 0x40000000 : (DWORD) size;
+    if (! ReadFile((HANDLE) _get_osfhandle(fd), p, chunk, &n_read, &ov) || n_read == 0)
+      return 1;
+#else
+    ssize_t n_read = pread(fd, p, size, off);
+    if (n_read <= 0)
+      return 1;
+#endif
+    p += n_read;
+    off += n_read;
+    size -= n_read;
+  }
+  return 0;
+}
+
+/*
+ * Hint that a range of the file will be read soon, so the OS can start
+ * reading it in the background.
+ */
+void file_readahead(int fd, uint64_t off, uint64_t size)
+{
+#if defined(POSIX_FADV_WILLNEED)
+  posix_fadvise(fd, off, size, POSIX_FADV_WILLNEED);
+#else
+  (void) fd;
+  (void) off;
+  (void) size;
+#endif
+}
+
 // memory
 
 static size_t mem_read(union READER_DATA *reader, void *data, size_t size)
@@ -85,6 +171,15 @@ static int mem_set_pos(union READER_DATA *reader, size_t pos)
   return 0;
 }
 
+static const void *mem_get_data(union READER_DATA *reader, size_t pos, size_t size)
+{
+  struct READER_MEM_DATA *mem = &reader->mem;
+
+  if (pos > mem->size || size > mem->size - pos)
+    return NULL;
+  return (char *) mem->data + pos;
+}
+
 void reader_from_memory(struct READER *r, const void *data, size_t size)
 {
   r->r.mem.data = data;
@@ -93,6 +188,7 @@ void reader_from_memory(struct READER *r, const void *data, size_t size)
 
   r->read = mem_read;
   r->set_pos = mem_set_pos;
+  r->get_data = mem_get_data;
 }
 
 // file
@@ -110,10 +206,16 @@ static int file_set_pos(union READER_DATA *reader, size_t pos)
   return fseek(reader->f, pos, SEEK_SET);
 }
 
+static const void *file_get_data(union READER_DATA *reader, size_t pos, size_t size)
+{
+  return NULL;
+}
+
 void reader_from_file(struct READER *r, FILE *f)
 {
   r->r.f = f;
 
   r->read = file_read;
   r->set_pos = file_set_pos;
+  r->get_data = file_get_data;
 }
@@ -5,6 +5,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <stdint.h>
 
 struct READER_MEM_DATA {
   const void *data;
@@ -20,11 +21,18 @@ union READER_DATA {
 struct READER {
   size_t (*read)(union READER_DATA *r, void *data, size_t size);
   int (*set_pos)(union READER_DATA *r, size_t pos);
+  const void *(*get_data)(union READER_DATA *r, size_t pos, size_t size);  // NULL if data is not in memory
   union READER_DATA r;
 };
 
 void *read_file(const char *filename, size_t *p_size);
 int read_file_data(const char *filename, size_t off, void *data, size_t size);
+int get_file_size(const char *filename, size_t *p_size);
+
+int file_open_read(const char *filename);
+void file_close(int fd);
+int file_pread(int fd, void *data, size_t size, uint64_t off);
+void file_readahead(int fd, uint64_t off, uint64_t size);
 
 void reader_from_file(struct READER *r, FILE *f);
 void reader_from_memory(struct READER *r, const void *data, size_t size);
@@ -59,6 +67,25 @@ static inline uint16_t get_u16_le(const void *p, size_t offset)
   return (d[1] << 8 | d[0]);
 }
 
+static inline uint64_t get_u64_be(const void *p, size_t offset)
+{
+  return (uint64_t) get_u32_be(p, offset) << 32 | get_u32_be(p, offset + 4);
+}
+
+static inline uint64_t get_u64_le(const void *p, size_t offset)
+{
+  return (uint64_t) get_u32_le(p, offset + 4) << 32 | get_u32_le(p, offset);
+}
+
+static inline void put_u32_le(void *p, size_t offset, uint32_t val)
+{
+  unsigned char *d = (unsigned char *) p + offset;
+  d[0] = val;
+  d[1] = val >> 8;
+  d[2] = val >> 16;
+  d[3] = val >> 24;
+}
+
 static inline float get_f32(const void *p, size_t offset)
 {
   float ret;
@@ -0,0 +1,128 @@
+/* sched.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sched.h"
+#include "reader.h"
+
+#define SCHED_BATCH_BYTES  (64*1024*1024)
+#define SCHED_BATCH_ITEMS  1024
+
+struct SCHED_ITEM {
+  size_t item;
+  uint64_t off;
+  size_t size;
+  size_t buf_off;
+  int ok;
+};
+
+static int compare_offsets(const void *p1, const void *p2)
+{
+  const struct SCHED_ITEM *i1 = p1;
+  const struct SCHED_ITEM *i2 = p2;
+  if (i1->off != i2->off)
+    return (i1->off < i2->off) ? -1 : 1;
+  return (i1->item < i2->item) ? -1 : (i1->item > i2->item);
+}
+
+static int compare_items(const void *p1, const void *p2)
+{
+  const struct SCHED_ITEM *i1 = p1;
+  const struct SCHED_ITEM *i2 = p2;
+  return (i1->item < i2->item) ? -1 : (i1->item > i2->item);
+}
+
+/*
+ * Find the items of the batch starting at 'first': consecutive items up
+ * to SCHED_BATCH_ITEMS items or SCHED_BATCH_BYTES bytes (but at least
+ * one item).
+ */
+static size_t get_batch(size_t first, size_t n_items, struct SCHED_ITEM *items,
+                        sched_pos_func get_pos, void *user, size_t *p_bytes)
+{
+  size_t n = 0;
+  size_t bytes = 0;
+  while (first + n < n_items && n < SCHED_BATCH_ITEMS) {
+    struct SCHED_ITEM *it = &items[n];
+    it->item = first + n;
+    it->ok = (get_pos(user, it->item, &it->off, &it->size) == 0);
+    if (! it->ok) {
+      it->off = 0;
+      it->size = 0;
+    }
+    if (n > 0 && it->size > SCHED_BATCH_BYTES - bytes)
+      break;
+    bytes += it->size;
+    n++;
+  }
+  *p_bytes = bytes;
+  return n;
+}
+
+/*
+ * Read and process items in batches.  The items of each batch are
+ * checked and read in order of their position in the archive file (so
+ * the file is read sequentially, and the OS is asked to read ahead),
+ * then processed in their original order.
+ */
+int sched_run(size_t n_items, int fd, sched_pos_func get_pos, sched_check_func check,
+              sched_read_func read, sched_process_func process, void *user)
+{
+  struct SCHED_ITEM *items = malloc(SCHED_BATCH_ITEMS * sizeof(struct SCHED_ITEM));
+  unsigned char *buf = NULL;
+  size_t buf_size = 0;
+  if (! items) {
+    printf("* ERROR: out of memory\n");
+    return 1;
+  }
+
+  int ret = 0;
+  size_t first = 0;
+  while (first < n_items && ret == 0) {
+    size_t bytes;
+    size_t n = get_batch(first, n_items, items, get_pos, user, &bytes);
+
+    qsort(items, n, sizeof(struct SCHED_ITEM), compare_offsets);
+    bytes = 0;
+    for (size_t i = 0; i < n; i++) {
+      if (check && items[i].ok && items[i].size > 0 && check(user, items[i].item, items[i].size) != 0)
+        items[i].size = 0;
+      items[i].buf_off = bytes;
+      bytes += items[i].size;
+    }
+
+    if (bytes + 1 > buf_size) {
+      free(buf);
+      buf_size = bytes + 1;
+      buf = malloc(buf_size);
+      if (! buf) {
+        printf("* ERROR: out of memory\n");
+        ret = 1;
+        break;
+      }
+    }
+
+    if (fd >= 0) {
+      for (size_t i = 0; i < n; i++) {
+        if (items[i].ok && items[i].size > 0)
+          file_readahead(fd, items[i].off, items[i].size);
+      }
+    }
+    for (size_t i = 0; i < n; i++) {
+      if (items[i].ok && read(user, items[i].item, buf + items[i].buf_off, items[i].size) != 0)
+        items[i].ok = 0;
+    }
+
+    qsort(items, n, sizeof(struct SCHED_ITEM), compare_items);
+    for (size_t i = 0; i < n && ret == 0; i++)
+      ret = process(user, items[i].item, (items[i].ok) ? buf + items[i].buf_off : NULL, items[i].size);
+    first += n;
+  }
+
+  free(buf);
+  free(items);
+  return ret;
+}
@@ -0,0 +1,36 @@
+/* sched.h */
+
+#ifndef SCHED_H_FILE
+#define SCHED_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Get the position of an item's data in the archive file.  Returns
+ * nonzero if the item can't be read.
+ */
+typedef int (*sched_pos_func)(void *user, size_t item, uint64_t *p_off, size_t *p_size);
+
+/*
+ * Check an item before it's read (optional, items are checked in order
+ * of position).  Return nonzero if its data doesn't need to be read; it's
+ * then processed with size 0.
+ */
+typedef int (*sched_check_func)(void *user, size_t item, size_t size);
+
+/*
+ * Read an item's data into 'buf'.  Returns nonzero on error.
+ */
+typedef int (*sched_read_func)(void *user, size_t item, void *buf, size_t size);
+
+/*
+ * Process an item, with 'data' NULL if it couldn't be read.  The data is
+ * only valid during the call.  Return nonzero to stop.
+ */
+typedef int (*sched_process_func)(void *user, size_t item, void *data, size_t size);
+
+int sched_run(size_t n_items, int fd, sched_pos_func get_pos, sched_check_func check,
+              sched_read_func read, sched_process_func process, void *user);
+
+#endif /* SCHED_H_FILE */
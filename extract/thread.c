@@ -0,0 +1,227 @@
+/* thread.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+
+static void mutex_init(mutex_t *m)    { InitializeCriticalSection(m); }
+static void mutex_destroy(mutex_t *m) { DeleteCriticalSection(m); }
+static void mutex_lock(mutex_t *m)    { EnterCriticalSection(m); }
+static void mutex_unlock(mutex_t *m)  { LeaveCriticalSection(m); }
+
+static DWORD WINAPI thread_main(LPVOID arg);
+
+static int thread_create(thread_t *t, void *arg)
+{
+  *t = CreateThread(NULL, 0, thread_main, arg, 0, NULL);
+  return (*t == NULL) ? 1 : 0;
+}
+
+static void thread_join(thread_t t)
+{
+  WaitForSingleObject(t, INFINITE);
+  CloseHandle(t);
+}
+
+int get_num_cpus(void)
+{
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (info.dwNumberOfProcessors > 0) ? (int) info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+#include <pthread.h>
+#include <unistd.h>
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+
+static void mutex_init(mutex_t *m)    { pthread_mutex_init(m, NULL); }
+static void mutex_destroy(mutex_t *m) { pthread_mutex_destroy(m); }
+static void mutex_lock(mutex_t *m)    { pthread_mutex_lock(m); }
+static void mutex_unlock(mutex_t *m)  { pthread_mutex_unlock(m); }
+
+static void *thread_main(void *arg);
+
+static int thread_create(thread_t *t, void *arg)
+{
+  return pthread_create(t, NULL, thread_main, arg);
+}
+
+static void thread_join(thread_t t)
+{
+  pthread_join(t, NULL);
+}
+
+int get_num_cpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0) ? (int) n : 1;
+}
+
+#endif
+
+#include "thread.h"
+
+#define MAX_THREADS 64
+
+struct PARALLEL_RUN {
+  mutex_t lock;
+  size_t next_job;
+  size_t n_jobs;
+  int failed;
+  parallel_job_func func;
+  parallel_worker_func worker_func;
+  void *data;
+};
+
+struct WORKER {
+  struct PARALLEL_RUN *run;
+  int worker_num;
+};
+
+static int max_threads;
+static THREAD_LOCAL int in_parallel_run;
+
+void set_max_threads(int n_threads)
+{
+  max_threads = n_threads;
+}
+
+int get_max_threads(void)
+{
+  if (max_threads > 0)
+    return max_threads;
+  return get_num_cpus();
+}
+
+static void run_jobs(struct WORKER *worker)
+{
+  struct PARALLEL_RUN *run = worker->run;
+
+  in_parallel_run = 1;
+  while (1) {
+    mutex_lock(&run->lock);
+    size_t job = run->next_job;
+    if (job < run->n_jobs)
+      run->next_job++;
+    mutex_unlock(&run->lock);
+    if (job >= run->n_jobs)
+      break;
+
+    int ret;
+    if (run->worker_func)
+      ret = run->worker_func(run->data, worker->worker_num, job);
+    else
+      ret = run->func(run->data, job);
+    if (ret != 0) {
+      mutex_lock(&run->lock);
+      run->failed = 1;
+      mutex_unlock(&run->lock);
+    }
+  }
+  in_parallel_run = 0;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI thread_main(LPVOID arg)
+{
+  run_jobs(arg);
+  return 0;
+}
+#else
+static void *thread_main(void *arg)
+{
+  run_jobs(arg);
+  return NULL;
+}
+#endif
+
+/*
+ * Return the number of threads that will run n_jobs jobs.  When called
+ * from inside a job, this is always 1: nested runs are not parallel, so
+ * that the thread count stays bounded by get_max_threads().
+ */
+int get_parallel_workers(size_t n_jobs)
+{
+  if (in_parallel_run)
+    return 1;
+
+  int n_threads = get_max_threads();
+  if (n_threads > MAX_THREADS)
+    n_threads = MAX_THREADS;
+  if ((size_t) n_threads > n_jobs)
+    n_threads = (n_jobs > 0) ? (int) n_jobs : 1;
+  return n_threads;
+}
+
+static int start_run(struct PARALLEL_RUN *run)
+{
+  thread_t threads[MAX_THREADS];
+  struct WORKER workers[MAX_THREADS];
+
+  run->next_job = 0;
+  run->failed = 0;
+  mutex_init(&run->lock);
+
+  int was_in_parallel_run = in_parallel_run;
+  int n_threads = get_parallel_workers(run->n_jobs);
+  for (int i = 0; i < n_threads; i++) {
+    workers[i].run = run;
+    workers[i].worker_num = i;
+  }
+
+  // the calling thread works too (as worker 0), so start one thread less
+  int n_started = 0;
+  while (n_started < n_threads - 1) {
+    if (thread_create(&threads[n_started], &workers[n_started+1]) != 0)
+      break;
+    n_started++;
+  }
+  run_jobs(&workers[0]);
+  for (int i = 0; i < n_started; i++)
+    thread_join(threads[i]);
+  in_parallel_run = was_in_parallel_run;
+
+  mutex_destroy(&run->lock);
+  return run->failed;
+}
+
+/*
+ * Run func(data, job_num) for each job_num in [0, n_jobs), using up
+ * to get_max_threads() threads (including the calling thread).
+ * Returns nonzero if any job returned nonzero.
+ */
+int run_parallel(size_t n_jobs, parallel_job_func func, void *data)
+{
+  struct PARALLEL_RUN r;
+  r.n_jobs = n_jobs;
+  r.func = func;
+  r.worker_func = NULL;
+  r.data = data;
+  return start_run(&r);
+}
+
+/*
+ * Same as run_parallel(), but also pass the number of the worker
+ * (thread) running the job, from 0 to get_parallel_workers(n_jobs)-1,
+ * so that workers can keep their own state between jobs.
+ */
+int run_parallel_workers(size_t n_jobs, parallel_worker_func func, void *data)
+{
+  struct PARALLEL_RUN r;
+  r.n_jobs = n_jobs;
+  r.func = NULL;
+  r.worker_func = func;
+  r.data = data;
+  return start_run(&r);
+}
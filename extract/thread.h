@@ -0,0 +1,24 @@
+/* thread.h */
+
+#ifndef THREAD_H_FILE
+#define THREAD_H_FILE
+
+#include <stddef.h>
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+typedef int (*parallel_job_func)(void *data, size_t job_num);
+typedef int (*parallel_worker_func)(void *data, int worker_num, size_t job_num);
+
+int get_num_cpus(void);
+void set_max_threads(int n_threads);
+int get_max_threads(void);
+int get_parallel_workers(size_t n_jobs);
+int run_parallel(size_t n_jobs, parallel_job_func func, void *data);
+int run_parallel_workers(size_t n_jobs, parallel_worker_func func, void *data);
+
+#endif /* THREAD_H_FILE */
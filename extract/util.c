@@ -1,12 +1,39 @@
 /* util.c */
 
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
+struct NAME_LIST {
+  char **names;
+  size_t n_names;
+  size_t alloc;
+};
+
+static int add_name(struct NAME_LIST *list, const char *name)
+{
+  if (list->n_names == list->alloc) {
+    size_t alloc = (list->alloc > 0) ? 2*list->alloc : 64;
+    char **names = realloc(list->names, alloc * sizeof(char *));
+    if (! names)
+      return 1;
+    list->names = names;
+    list->alloc = alloc;
+  }
+  char *copy = malloc(strlen(name) + 1);
+  if (! copy)
+    return 1;
+  strcpy(copy, name);
+  list->names[list->n_names++] = copy;
+  return 0;
+}
+
 #ifdef WIN32
 
 #include <direct.h>
 #include <sys/stat.h>  
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 
 static int create_dir(const char *path, unsigned int mode)
 {
@@ -14,6 +41,12 @@ static int create_dir(const char *path, unsigned int mode)
   return _mkdir(path);
 }
 
+int replace_file(const char *old_name, const char *new_name)
+{
+  remove(new_name);
+  return rename(old_name, new_name);
+}
+
 static int dir_exists(const char *path)
 {
   struct _stat st;
@@ -22,12 +55,52 @@ static int dir_exists(const char *path)
   return (st.st_mode & S_IFMT) == S_IFDIR;
 }
 
+static int read_dir(const char *dir, struct NAME_LIST *list)
+{
+  char *pattern = malloc(strlen(dir) + 3);
+  if (! pattern)
+    return 1;
+  sprintf(pattern, "%s\\*", dir);
+
+  WIN32_FIND_DATAA fd;
+  HANDLE h = FindFirstFileA(pattern, &fd);
+  free(pattern);
+  if (h == INVALID_HANDLE_VALUE)
+    return 1;
+
+  int ret = 0;
+  do {
+    if (strcmp(fd.cFileName, ".") != 0 && strcmp(fd.cFileName, "..") != 0
+        && add_name(list, fd.cFileName) != 0) {
+      ret = 1;
+      break;
+    }
+  } while (FindNextFileA(h, &fd));
+  FindClose(h);
+  return ret;
+}
+
+double get_time(void)
+{
+  LARGE_INTEGER freq, count;
+  QueryPerformanceFrequency(&freq);
+  QueryPerformanceCounter(&count);
+  return (double) count.QuadPart / (double) freq.QuadPart;
+}
+
 #else
 
 #include <sys/stat.h>
+#include <time.h>
+#include <dirent.h>
 
 #define create_dir mkdir
 
+int replace_file(const char *old_name, const char *new_name)
+{
+  return rename(old_name, new_name);
+}
+
 static int dir_exists(const char *path)
 {
   struct stat st;
@@ -36,6 +109,32 @@ static int dir_exists(const char *path)
   return (st.st_mode & S_IFMT) == S_IFDIR;
 }
 
+static int read_dir(const char *dir, struct NAME_LIST *list)
+{
+  DIR *d = opendir(dir);
+  if (! d)
+    return 1;
+
+  int ret = 0;
+  struct dirent *ent;
+  while ((ent = readdir(d)) != NULL) {
+    if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0
+        && add_name(list, ent->d_name) != 0) {
+      ret = 1;
+      break;
+    }
+  }
+  closedir(d);
+  return ret;
+}
+
+double get_time(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
 #endif
 
 #include "util.h"
@@ -56,6 +155,11 @@ static int mkdir_p_r(char *dir, unsigned int mode)
   return create_dir(dir, mode);
 }
 
+int is_dir(const char *path)
+{
+  return dir_exists(path);
+}
+
 int mkdir_p(const char *dir, unsigned int mode)
 {
   char *dir_buf = malloc(strlen(dir)+1);
@@ -68,3 +172,44 @@ int mkdir_p(const char *dir, unsigned int mode)
   return ret;
 }
 
+
+static int compare_names(const void *a, const void *b)
+{
+  return strcmp(*(char **) a, *(char **) b);
+}
+
+/*
+ * Call func(data, path) for each file under dir (recursively), in
+ * alphabetical order.  Stops and returns nonzero if func does.
+ */
+int list_dir(const char *dir, list_dir_func func, void *data)
+{
+  struct NAME_LIST list = { NULL, 0, 0 };
+  if (read_dir(dir, &list) != 0) {
+    for (size_t i = 0; i < list.n_names; i++)
+      free(list.names[i]);
+    free(list.names);
+    return 1;
+  }
+  qsort(list.names, list.n_names, sizeof(char *), compare_names);
+
+  int ret = 0;
+  for (size_t i = 0; i < list.n_names && ret == 0; i++) {
+    char *path = malloc(strlen(dir) + strlen(list.names[i]) + 2);
+    if (! path) {
+      ret = 1;
+      break;
+    }
+    sprintf(path, "%s/%s", dir, list.names[i]);
+    if (dir_exists(path))
+      ret = list_dir(path, func, data);
+    else
+      ret = func(data, path);
+    free(path);
+  }
+
+  for (size_t i = 0; i < list.n_names; i++)
+    free(list.names[i]);
+  free(list.names);
+  return ret;
+}
@@ -3,6 +3,12 @@
 #ifndef UTIL_H_FILE
 #define UTIL_H_FILE
 
+typedef int (*list_dir_func)(void *data, const char *path);
+
 int mkdir_p(const char *dir, unsigned int mode);
+int list_dir(const char *dir, list_dir_func func, void *data);
+int is_dir(const char *path);
+int replace_file(const char *old_name, const char *new_name);
+double get_time(void);
 
 #endif /* UTIL_H_FILE */
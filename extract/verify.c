@@ -0,0 +1,159 @@
+/* verify.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "verify.h"
+#include "dcx.h"
+#include "hash.h"
+#include "reader.h"
+#include "thread.h"
+#include "util.h"
+
+struct VERIFY_RUN {
+  struct VERIFY_ENTRY *entries;
+  struct DCX_CONTEXT *contexts;   // one for each worker
+};
+
+void verify_init_entry(struct VERIFY_ENTRY *entry, const char *name, const void *data, size_t size)
+{
+  entry->name = name;
+  entry->data = data;
+  entry->size = size;
+  entry->filename = NULL;
+  entry->fd = -1;
+  entry->offset = 0;
+  entry->out_of_bounds = 0;
+  entry->require_dcx = 0;
+  entry->ret = 1;
+  entry->inflated = 0;
+  entry->data_size = 0;
+  entry->crc32 = 0;
+  entry->xxh64 = 0;
+  entry->error[0] = '\0';
+}
+
+static int verify_entry(void *data, int worker_num, size_t entry_num)
+{
+  struct VERIFY_RUN *run = data;
+  struct VERIFY_ENTRY *entry = &run->entries[entry_num];
+  void *file_data = NULL;
+
+  if (entry->out_of_bounds) {
+    snprintf(entry->error, sizeof(entry->error), "data is outside the archive\n");
+    return 1;
+  }
+
+  const void *in = entry->data;
+  size_t in_size = entry->size;
+  if (entry->filename) {
+    in = file_data = read_file(entry->filename, &in_size);
+    if (! in) {
+      snprintf(entry->error, sizeof(entry->error), "can't read file\n");
+      return 1;
+    }
+    entry->size = in_size;
+  } else if (entry->fd >= 0) {
+    in = file_data = malloc(in_size + 1);
+    if (! in || file_pread(entry->fd, file_data, in_size, entry->offset) != 0) {
+      snprintf(entry->error, sizeof(entry->error), "can't read file\n");
+      goto err;
+    }
+  }
+
+  const void *out = in;
+  size_t out_size = in_size;
+  if (in_size >= 0x40 && memcmp(in, "DCX", 4) == 0) {
+    struct DCX_INFO info;
+    if (dcx_probe(in, in_size, &info) != 0) {
+      snprintf(entry->error, sizeof(entry->error), "bad DCX header\n");
+      goto err;
+    }
+    if (info.format == DCX_FORMAT_DFLT && info.comp_size > in_size - 0x4c) {
+      snprintf(entry->error, sizeof(entry->error), "DCX data is truncated (%lu bytes missing)\n",
+               (unsigned long) (info.comp_size - (in_size - 0x4c)));
+      goto err;
+    }
+
+    dcx_set_error_buffer(entry->error, sizeof(entry->error));
+    out = dcx_ctx_read_mem(&run->contexts[worker_num], in, in_size, &out_size);
+    dcx_set_error_buffer(NULL, 0);
+    if (! out)
+      goto err;
+    if (out_size != info.data_size) {
+      snprintf(entry->error, sizeof(entry->error), "decompressed size is %lu, header says %lu\n",
+               (unsigned long) out_size, (unsigned long) info.data_size);
+      goto err;
+    }
+    entry->inflated = 1;
+  } else if (entry->require_dcx) {
+    snprintf(entry->error, sizeof(entry->error), "not a DCX file\n");
+    goto err;
+  }
+
+  entry->data_size = out_size;
+  entry->crc32 = crc32_data(out, out_size);
+  entry->xxh64 = xxh64(out, out_size, 0);
+  entry->ret = 0;
+  free(file_data);
+  return 0;
+
+ err:
+  free(file_data);
+  return 1;
+}
+
+/*
+ * Decompress (if needed) and checksum all entries in parallel, then
+ * print a report in entry order.  Returns the number of bad entries.
+ */
+size_t verify_entries(struct VERIFY_ENTRY *entries, size_t n_entries)
+{
+  struct VERIFY_RUN run;
+  run.entries = entries;
+
+  int n_workers = get_parallel_workers(n_entries);
+  run.contexts = malloc(n_workers * sizeof(struct DCX_CONTEXT));
+  if (! run.contexts) {
+    printf("Out of memory\n");
+    return n_entries;
+  }
+  int n_contexts = 0;
+  for (; n_contexts < n_workers; n_contexts++) {
+    if (dcx_init_context(&run.contexts[n_contexts]) != 0)
+      break;
+    run.contexts[n_contexts].use_cache = 0;  // verify the real data
+  }
+
+  double start = get_time();
+  if (n_contexts == n_workers)
+    run_parallel_workers(n_entries, verify_entry, &run);
+  double time = get_time() - start;
+
+  size_t n_bad = 0;
+  double in_bytes = 0;
+  double out_bytes = 0;
+  for (size_t i = 0; i < n_entries; i++) {
+    struct VERIFY_ENTRY *entry = &entries[i];
+    if (entry->ret != 0) {
+      printf("BAD  %s: %s", entry->name, (entry->error[0] != '\0') ? entry->error : "error\n");
+      n_bad++;
+      continue;
+    }
+    printf("ok   %08x %016llx %10lu%s %s\n", (unsigned) entry->crc32, (unsigned long long) entry->xxh64,
+           (unsigned long) entry->data_size, (entry->inflated) ? "*" : " ", entry->name);
+    in_bytes += entry->size;
+    out_bytes += entry->data_size;
+  }
+  printf("%lu entries, %lu bad, %.1f MB (%.1f MB inflated) verified in %.3f s",
+         (unsigned long) n_entries, (unsigned long) n_bad, in_bytes / 1.0e6, out_bytes / 1.0e6, time);
+  if (time > 0)
+    printf(", %.1f MB/s", out_bytes / time / 1.0e6);
+  printf("\n");
+
+  for (int i = 0; i < n_contexts; i++)
+    dcx_free_context(&run.contexts[i]);
+  free(run.contexts);
+  return n_bad;
+}
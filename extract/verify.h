@@ -0,0 +1,32 @@
+/* verify.h */
+
+#ifndef VERIFY_H_FILE
+#define VERIFY_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct VERIFY_ENTRY {
+  // input: either data/size, filename or fd/offset/size (read when verifying)
+  const char *name;
+  const void *data;
+  size_t size;
+  const char *filename;
+  int fd;
+  uint64_t offset;
+  int out_of_bounds;   // set if the entry data is not inside the archive
+  int require_dcx;     // set if the entry must be a DCX file
+
+  // result
+  int ret;
+  int inflated;
+  size_t data_size;
+  uint32_t crc32;
+  uint64_t xxh64;
+  char error[256];
+};
+
+void verify_init_entry(struct VERIFY_ENTRY *entry, const char *name, const void *data, size_t size);
+size_t verify_entries(struct VERIFY_ENTRY *entries, size_t n_entries);
+
+#endif /* VERIFY_H_FILE */
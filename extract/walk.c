@@ -0,0 +1,190 @@
+/* walk.c */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "walk.h"
+#include "bnd.h"
+#include "bhd.h"
+#include "dcx.h"
+#include "sched.h"
+#include "reader.h"
+
+#define WALK_MAX_DEPTH 16
+
+static int walk(const char *path, const void *data, size_t size, walk_func func, void *user, int depth);
+
+static char *join_path(const char *parent, const char *name)
+{
+  char *path = malloc(strlen(parent) + 1 + strlen(name) + 1);
+  if (! path)
+    return NULL;
+  sprintf(path, "%s/%s", parent, name);
+  return path;
+}
+
+static int walk_entry(const char *parent, const char *name, unsigned int file_num,
+                      const void *data, size_t size, walk_func func, void *user, int depth)
+{
+  char id_name[16];
+  if (! name) {
+    snprintf(id_name, sizeof(id_name), "%u", file_num);
+    name = id_name;
+  }
+
+  char *path = join_path(parent, name);
+  if (! path) {
+    printf("* ERROR: out of memory\n");
+    return 1;
+  }
+  int ret = walk(path, data, size, func, user, depth);
+  free(path);
+  return ret;
+}
+
+static int walk_bnd(const char *path, const void *data, size_t size, walk_func func, void *user, int depth)
+{
+  struct BND_FILE bnd;
+  if (bnd_open_mem(&bnd, data, size) != 0)
+    return func(user, path, data, size);
+
+  int ret = 0;
+  for (uint32_t file_num = 0; file_num < bnd.n_files && ret == 0; file_num++) {
+    char *name = NULL;
+    size_t file_size;
+    uint64_t off;
+    if (bnd_get_file_info(&bnd, file_num, &file_size, &name) != 0
+        || bnd_get_file_pos(&bnd, file_num, &off) != 0) {
+      printf("* ERROR: file %u of '%s' is out of bounds\n", (unsigned) file_num, path);
+      continue;
+    }
+    ret = walk_entry(path, name, file_num, bnd.data + off, file_size, func, user, depth + 1);
+  }
+
+  bnd_close(&bnd);
+  return ret;
+}
+
+static int walk(const char *path, const void *data, size_t size, walk_func func, void *user, int depth)
+{
+  if (depth > WALK_MAX_DEPTH || size < 4)
+    return func(user, path, data, size);
+
+  // inflate, walk the inflated data and free it right away
+  if (size >= 0x40 && memcmp(data, "DCX", 4) == 0) {
+    size_t data_size;
+    void *inflated = dcx_read_mem(data, size, &data_size);
+    if (! inflated) {
+      printf("* ERROR inflating '%s'\n", path);
+      return 0;
+    }
+    int ret = walk(path, inflated, data_size, func, user, depth + 1);
+    free(inflated);
+    return ret;
+  }
+
+  if (memcmp(data, "BND3", 4) == 0 || memcmp(data, "BND4", 4) == 0)
+    return walk_bnd(path, data, size, func, user, depth);
+
+  return func(user, path, data, size);
+}
+
+/*
+ * Walk the data of a file (which may be a container) from memory,
+ * calling func() for every leaf file.  Containers are opened in place
+ * and DCX data is inflated only while its contents are being walked.
+ */
+int walk_mem(const char *path, const void *data, size_t size, walk_func func, void *user)
+{
+  return walk(path, data, size, func, user, 0);
+}
+
+struct WALK_BHD {
+  struct BHD_FILE *f;
+  const char *filename;
+  walk_func func;
+  void *user;
+};
+
+static int get_bhd_file_pos(void *user, size_t file_num, uint64_t *p_off, size_t *p_size)
+{
+  struct WALK_BHD *w = user;
+  if (bhd_get_file_info(w->f, file_num, p_size, NULL) != 0)
+    return 1;
+  return bhd_get_file_pos(w->f, file_num, p_off);
+}
+
+static int read_bhd_file(void *user, size_t file_num, void *buf, size_t size)
+{
+  struct WALK_BHD *w = user;
+  return bhd_read_file(w->f, file_num, 0, buf, size);
+}
+
+static int walk_bhd_file(void *user, size_t file_num, void *data, size_t size)
+{
+  struct WALK_BHD *w = user;
+  char *name = NULL;
+  bhd_get_file_info(w->f, file_num, NULL, &name);
+  if (! data) {
+    printf("* ERROR: can't read file %u of '%s'\n", (unsigned) file_num, w->filename);
+    return 0;
+  }
+  return walk_entry(w->filename, name, file_num, data, size, w->func, w->user, 1);
+}
+
+static int walk_bhd(const char *filename, walk_func func, void *user)
+{
+  struct BHD_FILE f;
+  if (bhd_open(&f, filename) != 0) {
+    printf("* ERROR: can't open '%s'\n", filename);
+    return 1;
+  }
+
+  struct WALK_BHD w = {
+    .f = &f,
+    .filename = filename,
+    .func = func,
+    .user = user,
+  };
+  int ret = 0;
+  if (f.bdt) {
+    for (uint32_t file_num = 0; file_num < f.n_files && ret == 0; file_num++) {
+      size_t size;
+      char *data = bhd_get_file(&f, file_num, &size, NULL);
+      ret = walk_bhd_file(&w, file_num, data, size);
+    }
+  } else {
+    // BHD5: read the files in the order they're stored in the BDT
+    ret = sched_run(f.n_files, f.bdt_fd, get_bhd_file_pos, NULL, read_bhd_file, walk_bhd_file, &w);
+  }
+
+  bhd_close(&f);
+  return ret;
+}
+
+/*
+ * Walk a file.  BHD files are opened with their BDT, anything else is
+ * read to memory and walked with walk_mem().
+ */
+int walk_file(const char *filename, walk_func func, void *user)
+{
+  char magic[4];
+  if (read_file_data(filename, 0, magic, 4) != 0) {
+    printf("* ERROR: can't open '%s'\n", filename);
+    return 1;
+  }
+  if (memcmp(magic, "BHF3", 4) == 0 || memcmp(magic, "BHD5", 4) == 0)
+    return walk_bhd(filename, func, user);
+
+  size_t size;
+  void *data = read_file(filename, &size);
+  if (! data) {
+    printf("* ERROR: can't read '%s'\n", filename);
+    return 1;
+  }
+  int ret = walk_mem(filename, data, size, func, user);
+  free(data);
+  return ret;
+}
@@ -0,0 +1,18 @@
+/* walk.h */
+
+#ifndef WALK_H_FILE
+#define WALK_H_FILE
+
+#include <stddef.h>
+
+/*
+ * Called for each leaf file found when walking nested containers.
+ * 'path' is the virtual path of the file ("outer/inner/.../name"), and
+ * 'data' is only valid during the call.  Return nonzero to stop.
+ */
+typedef int (*walk_func)(void *user, const char *path, const void *data, size_t size);
+
+int walk_file(const char *filename, walk_func func, void *user);
+int walk_mem(const char *path, const void *data, size_t size, walk_func func, void *user);
+
+#endif /* WALK_H_FILE */
@@ -0,0 +1,556 @@
+/* writer.c */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "writer.h"
+#include "dcx.h"
+#include "reader.h"
+#include "util.h"
+
+// directories kept open, to stay well below the usual limit of open files
+#define WRITER_MAX_OPEN_DIRS  256
+
+// buffer size used to copy files when the kernel can't do it
+#define WRITER_COPY_BUF_SIZE  (1024*1024)
+
+#define TAR_BLOCK_SIZE  512
+
+#ifdef _WIN32
+#define WRITER_ROOT_FD  -1
+#define dup _dup
+#define dup2 _dup2
+#define close _close
+#define fdopen _fdopen
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#else
+#define WRITER_ROOT_FD  AT_FDCWD
+#endif
+
+void writer_init(struct WRITER *w)
+{
+  w->dirs = NULL;
+  w->n_slots = 0;
+  w->n_dirs = 0;
+  w->n_open = 0;
+  w->tar = NULL;
+  w->tar_mtime = 0;
+  w->tar_failed = 0;
+}
+
+/*
+ * Write all files to a tar file instead of extracting them, or to the
+ * standard output if 'filename' is "-" (the standard output is then
+ * redirected to the standard error, so that messages don't end up in
+ * the tar stream).
+ */
+int writer_open_tar(struct WRITER *w, const char *filename)
+{
+  if (strcmp(filename, "-") == 0) {
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd < 0)
+      return 1;
+#ifdef _WIN32
+    _setmode(fd, _O_BINARY);
+#endif
+    w->tar = fdopen(fd, "wb");
+    if (! w->tar) {
+      close(fd);
+      return 1;
+    }
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+  } else {
+    w->tar = fopen(filename, "wb");
+    if (! w->tar)
+      return 1;
+  }
+  w->tar_mtime = time(NULL);
+  return 0;
+}
+
+/*
+ * Free the writer, ending the tar stream if there's one.  Returns
+ * nonzero if the tar stream couldn't be written.
+ */
+int writer_close(struct WRITER *w)
+{
+  int ret = 0;
+  if (w->tar) {
+    // the end of the archive is marked by two empty blocks
+    static const char end[2*TAR_BLOCK_SIZE];
+    if (fwrite(end, 1, sizeof(end), w->tar) != sizeof(end))
+      w->tar_failed = 1;
+    if (fclose(w->tar) != 0)
+      w->tar_failed = 1;
+    ret = w->tar_failed;
+  }
+
+  for (size_t i = 0; i < w->n_slots; i++) {
+    if (! w->dirs[i].path)
+      continue;
+#ifndef _WIN32
+    if (w->dirs[i].fd >= 0)
+      close(w->dirs[i].fd);
+#endif
+    free(w->dirs[i].path);
+  }
+  free(w->dirs);
+  writer_init(w);
+  return ret;
+}
+
+static uint32_t hash_path(const char *path, size_t len)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    hash = (hash ^ (unsigned char) path[i]) * 16777619u;
+  return hash;
+}
+
+static struct WRITER_DIR *find_slot(struct WRITER_DIR *dirs, size_t n_slots, const char *path, size_t len)
+{
+  size_t i = hash_path(path, len) & (n_slots - 1);
+  while (dirs[i].path && (strncmp(dirs[i].path, path, len) != 0 || dirs[i].path[len] != '\0'))
+    i = (i + 1) & (n_slots - 1);
+  return &dirs[i];
+}
+
+static int add_dir(struct WRITER *w, const char *path, size_t len, int fd)
+{
+  if (2 * (w->n_dirs + 1) > w->n_slots) {
+    size_t n_slots = (w->n_slots > 0) ? 2 * w->n_slots : 64;
+    struct WRITER_DIR *dirs = calloc(n_slots, sizeof(struct WRITER_DIR));
+    if (! dirs)
+      return 1;
+    for (size_t i = 0; i < w->n_slots; i++) {
+      if (w->dirs[i].path)
+        *find_slot(dirs, n_slots, w->dirs[i].path, strlen(w->dirs[i].path)) = w->dirs[i];
+    }
+    free(w->dirs);
+    w->dirs = dirs;
+    w->n_slots = n_slots;
+  }
+
+  char *copy = malloc(len + 1);
+  if (! copy)
+    return 1;
+  memcpy(copy, path, len);
+  copy[len] = '\0';
+  struct WRITER_DIR *dir = find_slot(w->dirs, w->n_slots, path, len);
+  dir->path = copy;
+  dir->fd = fd;
+  w->n_dirs++;
+  if (fd >= 0)
+    w->n_open++;
+  return 0;
+}
+
+/*
+ * Create the directory with the first 'len' characters of 'path' (and
+ * its parents) if it's not known yet, and get its fd (-1 if it's not
+ * kept open).  'path' is modified during the call, but restored.
+ */
+static int get_dir(struct WRITER *w, char *path, size_t len, int *p_fd)
+{
+  if (len == 0) {
+    *p_fd = WRITER_ROOT_FD;
+    return 0;
+  }
+  if (w->n_slots > 0) {
+    struct WRITER_DIR *dir = find_slot(w->dirs, w->n_slots, path, len);
+    if (dir->path) {
+      *p_fd = dir->fd;
+      return 0;
+    }
+  }
+
+  char save = path[len];
+  path[len] = '\0';
+  int fd = -1;
+#ifdef _WIN32
+  int ret = mkdir_p(path, 0777);
+#else
+  char *slash = strrchr(path, '/');
+  size_t parent_len = (slash) ? slash - path : 0;
+  int parent_fd;
+  int ret = get_dir(w, path, parent_len, &parent_fd);
+  if (ret == 0) {
+    // create relative to the parent if it's open, or else by full path
+    const char *name = (parent_fd >= 0) ? slash + 1 : path;
+    int at_fd = (parent_fd >= 0) ? parent_fd : AT_FDCWD;
+    if (mkdirat(at_fd, name, 0777) != 0 && errno != EEXIST)
+      ret = 1;
+    else if (w->n_open < WRITER_MAX_OPEN_DIRS
+             && (fd = openat(at_fd, name, O_RDONLY | O_DIRECTORY)) < 0)
+      ret = 1;
+  }
+#endif
+  if (ret == 0 && add_dir(w, path, len, fd) != 0) {
+#ifndef _WIN32
+    if (fd >= 0)
+      close(fd);
+#endif
+    fd = -1;
+    ret = 1;
+  }
+  path[len] = save;
+  *p_fd = fd;
+  return ret;
+}
+
+/*
+ * Open a file for writing, relative to the directory fd 'dir_fd'
+ * (or by its full path) and reserve 'size' bytes for it.
+ */
+static FILE *open_file(const char *path, const char *name, int dir_fd, size_t size)
+{
+#ifdef _WIN32
+  (void) name;
+  (void) dir_fd;
+  (void) size;
+  return fopen(path, "wb");
+#else
+  int fd = (dir_fd >= 0) ? openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC, 0666) : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    return NULL;
+#ifdef __linux__
+  // reserve the space up front (ignored if the filesystem can't)
+  if (size > 0)
+    fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size);
+#endif
+  FILE *f = fdopen(fd, "wb");
+  if (! f)
+    close(fd);
+  return f;
+#endif
+}
+
+/*
+ * Get the extraction path of a file (relative, with '/' or '\' as
+ * separators) as a malloc()ed string, or NULL if it can't be extracted.
+ */
+static char *get_output_name(const char *in_filename, int inflate)
+{
+  if (strstr(in_filename, "..") != NULL) {
+    printf("Refusing to extract file containing '..' in name ('%s')\n", in_filename);
+    return NULL;
+  }
+
+  char *filename = malloc(strlen(in_filename) + 1);
+  if (! filename) {
+    printf("Out of memory to extract file '%s'\n", in_filename);
+    return NULL;
+  }
+  strcpy(filename, in_filename);
+
+  // remove '.dcx' extension if file is inflated
+  if (inflate) {
+    char *dot = strrchr(filename, '.');
+    if (dot && strcmp(dot, ".dcx") == 0) {
+      *dot = '\0';
+    }
+  }
+
+  // convert backslashes to slashes
+  for (char *p = filename; *p != '\0'; p++) {
+    if (*p == '\\')
+      *p = '/';
+  }
+  return filename;
+}
+
+/*
+ * Get the extraction path of a file, create its directory if needed and
+ * open it, reserving 'out_size' bytes.  On errors NULL is returned, and
+ * '*p_filename' is also NULL unless the error was in opening the file.
+ */
+static FILE *open_output(struct WRITER *w, const char *in_filename, int inflate, size_t out_size, char **p_filename)
+{
+  *p_filename = NULL;
+  char *filename = get_output_name(in_filename, inflate);
+  if (! filename)
+    return NULL;
+
+  printf("-> extracting '%s'\n", filename);
+
+  // create directory
+  char *slash = strrchr(filename, '/');
+  size_t dir_len = (slash) ? slash - filename : 0;
+  int dir_fd;
+  if (get_dir(w, filename, dir_len, &dir_fd) != 0) {
+    filename[dir_len] = '\0';
+    printf("Can't create directory '%s'\n", filename);
+    free(filename);
+    return NULL;
+  }
+
+  *p_filename = filename;
+  return open_file(filename, (slash) ? slash + 1 : filename, dir_fd, out_size);
+}
+
+/*
+ * Copy 'size' bytes at 'off' of 'in_fd' to the end of 'f', letting the
+ * kernel copy the data when it can.
+ */
+static int copy_range(FILE *f, int in_fd, uint64_t off, size_t size)
+{
+#ifdef __linux__
+  int out_fd = fileno(f);
+  loff_t in_off = off;
+  while (size > 0) {
+    ssize_t n = copy_file_range(in_fd, &in_off, out_fd, NULL, size, 0);
+    if (n <= 0)
+      break;
+    size -= n;
+  }
+
+  // copy_file_range() is not supported everywhere (e.g. across filesystems
+  // before Linux 5.3): try sendfile()
+  while (size > 0) {
+    off_t s_off = in_off;
+    ssize_t n = sendfile(out_fd, in_fd, &s_off, size);
+    if (n <= 0)
+      break;
+    in_off = s_off;
+    size -= n;
+  }
+  off = in_off;
+#endif
+
+  // fall back to reading and writing
+  if (size == 0)
+    return 0;
+  size_t buf_size = (size < WRITER_COPY_BUF_SIZE) ? size : WRITER_COPY_BUF_SIZE;
+  char *buf = malloc(buf_size);
+  if (! buf)
+    return 1;
+  int ret = 0;
+  while (size > 0 && ret == 0) {
+    size_t len = (size < buf_size) ? size : buf_size;
+    if (file_pread(in_fd, buf, len, off) != 0) {
+      ret = 1;
+      break;
+    }
+#ifdef _WIN32
+    if (fwrite(buf, 1, len, f) != len)
+      ret = 1;
+#else
+    // 'f' has nothing buffered, write to its fd directly like the code above
+    for (size_t pos = 0; pos < len && ret == 0; ) {
+      ssize_t n = write(fileno(f), buf + pos, len - pos);
+      if (n <= 0)
+        ret = 1;
+      else
+        pos += n;
+    }
+#endif
+    off += len;
+    size -= len;
+  }
+  free(buf);
+  return ret;
+}
+
+// tar output, in GNU format (for names over 100 characters and huge files)
+
+static void put_tar_number(char *field, size_t len, uint64_t val)
+{
+  if (val < (uint64_t) 1 << (3 * (len - 1))) {
+    // octal, NUL-terminated
+    field[len - 1] = '\0';
+    for (size_t i = len - 1; i > 0; i--) {
+      field[i - 1] = '0' + (val & 7);
+      val >>= 3;
+    }
+  } else {
+    // big endian base-256, marked by the high bit
+    for (size_t i = len; i > 1; i--) {
+      field[i - 1] = (char) (val & 0xff);
+      val >>= 8;
+    }
+    field[0] = (char) 0x80;
+  }
+}
+
+static int pad_tar(struct WRITER *w, uint64_t size)
+{
+  static const char zeros[TAR_BLOCK_SIZE];
+  size_t pad = (TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+  return fwrite(zeros, 1, pad, w->tar) != pad;
+}
+
+static int write_tar_header(struct WRITER *w, const char *name, char type, uint64_t size)
+{
+  char header[TAR_BLOCK_SIZE];
+  memset(header, 0, sizeof(header));
+  size_t len = strlen(name);
+  memcpy(header, name, (len < 100) ? len : 100);
+  put_tar_number(header + 100, 8, 0644);
+  put_tar_number(header + 108, 8, 0);
+  put_tar_number(header + 116, 8, 0);
+  put_tar_number(header + 124, 12, size);
+  put_tar_number(header + 136, 12, w->tar_mtime);
+  header[156] = type;
+  memcpy(header + 257, "ustar  ", 8);
+
+  // the checksum is calculated with the checksum field set to spaces
+  memset(header + 148, ' ', 8);
+  unsigned int sum = 0;
+  for (size_t i = 0; i < TAR_BLOCK_SIZE; i++)
+    sum += (unsigned char) header[i];
+  put_tar_number(header + 148, 7, sum);
+
+  return fwrite(header, 1, TAR_BLOCK_SIZE, w->tar) != TAR_BLOCK_SIZE;
+}
+
+/*
+ * Write the header of a file, preceded by a long name entry if the
+ * name doesn't fit in the header.
+ */
+static int start_tar_file(struct WRITER *w, const char *name, uint64_t size)
+{
+  size_t len = strlen(name);
+  if (len > 100
+      && (write_tar_header(w, "././@LongLink", 'L', len + 1) != 0
+          || fwrite(name, 1, len + 1, w->tar) != len + 1
+          || pad_tar(w, len + 1) != 0))
+    return 1;
+  return write_tar_header(w, name, '0', size);
+}
+
+/*
+ * Add a file to the tar stream.  The header has the file size, so DCX
+ * data is inflated to memory first: a bad file is skipped instead of
+ * breaking the stream.
+ */
+static int tar_extract(struct WRITER *w, const char *in_filename, const void *data, size_t size, int inflate)
+{
+  char *filename = get_output_name(in_filename, inflate);
+  if (! filename)
+    return 1;
+
+  void *inflated = NULL;
+  if (inflate) {
+    inflated = dcx_read_mem(data, size, &size);
+    if (! inflated) {
+      printf("ERROR inflating '%s'\n", filename);
+      free(filename);
+      return 1;
+    }
+    data = inflated;
+  }
+
+  printf("-> extracting '%s'\n", filename);
+  int ret = (start_tar_file(w, filename, size) != 0
+             || fwrite(data, 1, size, w->tar) != size
+             || pad_tar(w, size) != 0);
+  if (ret != 0) {
+    printf("ERROR writing '%s'\n", filename);
+    w->tar_failed = 1;
+  }
+  free(inflated);
+  free(filename);
+  return ret;
+}
+
+static int tar_copy(struct WRITER *w, const char *in_filename, int in_fd, uint64_t off, size_t size)
+{
+  char *filename = get_output_name(in_filename, 0);
+  if (! filename)
+    return 1;
+
+  printf("-> extracting '%s'\n", filename);
+  int ret = (start_tar_file(w, filename, size) != 0
+             || fflush(w->tar) != 0
+             || copy_range(w->tar, in_fd, off, size) != 0
+             || pad_tar(w, size) != 0);
+  if (ret != 0) {
+    printf("ERROR writing '%s'\n", filename);
+    w->tar_failed = 1;
+  }
+  free(filename);
+  return ret;
+}
+
+/*
+ * Write a file to its extraction path.  If 'inflate' is set, the data
+ * is DCX and is inflated while writing.
+ */
+int writer_extract(struct WRITER *w, const char *in_filename, const void *data, size_t size, int inflate)
+{
+  if (w->tar)
+    return tar_extract(w, in_filename, data, size, inflate);
+
+  size_t out_size = size;
+  struct DCX_INFO info;
+  if (inflate)
+    out_size = (dcx_probe(data, size, &info) == 0) ? info.data_size : 0;
+
+  char *filename;
+  FILE *f = open_output(w, in_filename, inflate, out_size, &filename);
+  if (! filename)
+    return 1;
+
+  int ret = 0;
+  if (! f) {
+    ret = 1;
+  } else if (inflate) {
+    size_t written;
+    ret = dcx_write_mem(data, size, f, &written);
+  } else if (fwrite(data, 1, size, f) != size) {
+    ret = 1;
+  }
+  if (f && fclose(f) != 0)
+    ret = 1;
+  if (ret != 0)
+    printf("ERROR writing '%s'\n", filename);
+  free(filename);
+  return ret;
+}
+
+/*
+ * Write a file to its extraction path, copying 'size' bytes at 'off'
+ * of 'in_fd' (the archive), without reading them into memory when the
+ * kernel can copy them.
+ */
+int writer_copy(struct WRITER *w, const char *in_filename, int in_fd, uint64_t off, size_t size)
+{
+  if (w->tar)
+    return tar_copy(w, in_filename, in_fd, off, size);
+
+  char *filename;
+  FILE *f = open_output(w, in_filename, 0, size, &filename);
+  if (! filename)
+    return 1;
+
+  int ret = (! f || copy_range(f, in_fd, off, size) != 0);
+  if (f && fclose(f) != 0)
+    ret = 1;
+  if (ret != 0)
+    printf("ERROR writing '%s'\n", filename);
+  free(filename);
+  return ret;
+}
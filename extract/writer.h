@@ -0,0 +1,40 @@
+/* writer.h */
+
+#ifndef WRITER_H_FILE
+#define WRITER_H_FILE
+
+#include <stddef.h>
+#include <stdint.h>
+
+// smallest file worth extracting with writer_copy() instead of reading it
+#define WRITER_COPY_MIN_SIZE  (64*1024)
+
+struct WRITER_DIR {
+  char *path;               // NULL for empty slots
+  int fd;                   // -1 if the directory is not kept open
+};
+
+/*
+ * Writes extracted files under the current directory.  Directories are
+ * created once and remembered, and files are opened relative to the
+ * (kept open) directory that contains them.  After writer_open_tar(),
+ * files are written to a tar stream instead.
+ */
+struct WRITER {
+  struct WRITER_DIR *dirs;  // open addressing table, keyed by path
+  size_t n_slots;
+  size_t n_dirs;
+  size_t n_open;
+
+  FILE *tar;                // NULL if not writing a tar
+  uint64_t tar_mtime;
+  int tar_failed;           // set if the tar stream may be broken
+};
+
+void writer_init(struct WRITER *w);
+int writer_open_tar(struct WRITER *w, const char *filename);
+int writer_close(struct WRITER *w);
+int writer_extract(struct WRITER *w, const char *filename, const void *data, size_t size, int inflate);
+int writer_copy(struct WRITER *w, const char *filename, int in_fd, uint64_t off, size_t size);
+
+#endif /* WRITER_H_FILE */
@@ -54,7 +54,7 @@ static int add_index(struct model *l, unsigned int f1, unsigned int f2, unsigned
   return 0;
 }
 
-static int load_model(struct model *model, const char *filename)
+static int load_model(struct model *model, const char *filename, int no_normals)
 {
   FILE *f = fopen(filename, "r");
   if (! f)
@@ -115,7 +115,7 @@ static int load_model(struct model *model, const char *filename)
     goto err;
   }
 
-  if (gen_normals(model) != 0)
+  if (! no_normals && gen_normals(model) != 0)
     goto err;
   
   fclose(f);
@@ -150,7 +150,7 @@ static int write_model(const struct model *model, const char *filename)
       printf("* ERROR writing vertex %d\n", i);
       goto err;
     }
-    if (fwrite(&model->normals[3*i], 1, 3*4, f) != 3*4) {
+    if (model->normals && fwrite(&model->normals[3*i], 1, 3*4, f) != 3*4) {
       printf("* ERROR writing normal %d\n", i);
       goto err;
     }
@@ -171,8 +171,15 @@ static int write_model(const struct model *model, const char *filename)
 
 int main(int argc, char *argv[])
 {
+  int no_normals = 0;
+  if (argc == 4 && strcmp(argv[1], "-f") == 0) {
+    no_normals = 1;
+    argc--;
+    argv++;
+  }
   if (argc != 3) {
-    printf("USAGE: genmap input_dir output_dir\n");
+    printf("USAGE: genmap [-f] input_dir output_dir\n");
+    printf("  -f   don't generate normals (for dsview flat shading mode)\n");
     return 1;
   }
   const char *input_dir = argv[1];
@@ -189,7 +196,7 @@ int main(int argc, char *argv[])
     
     printf("- processing '%s'...\n", model_files[i]);
 
-    if (load_model(&model, model_files[i]) != 0) {
+    if (load_model(&model, model_files[i], no_normals) != 0) {
       printf("* ERROR loading '%s'\n", model_files[i]);
       return 1;
     }